@@ -149,8 +149,9 @@ struct RasterizerCG {
         return CGRectMake(bounds.lx, bounds.ly, bounds.ux - bounds.lx, bounds.uy - bounds.ly);
     }
     static void writePathToCGContext(Ra::Geometry *g, CGContextRef ctx) {
+        Ra::Row<float> decoded;  float *points = g->decodedPoints(decoded);
         for (size_t index = 0; index < g->types.end; ) {
-            float *p = g->points.base + index * 2;
+            float *p = points + index * 2;
             switch (*(g->types.base + index)) {
                 case Ra::Geometry::kMove:
                     CGContextMoveToPoint(ctx, p[0], p[1]);
@@ -130,6 +130,10 @@
                                                length:buffer->size
                                               options:MTLResourceStorageModeShared
                                           deallocator:nil];
+    id <MTLBuffer> poolBuffer = buffer->pool.ptr == nullptr ? nil : [self.device newBufferWithBytesNoCopy:buffer->pool->base
+                                               length:buffer->pool->size
+                                              options:MTLResourceStorageModeShared
+                                          deallocator:nil], ptsBuffer = mtlBuffer;
 
     _converter.matchColors((Ra::Colorant *)(buffer->base + buffer->colors), buffer->pathsCount, colorSpace);
     
@@ -179,7 +183,10 @@
                 segbase = entry.begin;
                 break;
             case Ra::Buffer::kPointsBase:
-                ptsbase = entry.begin;
+                ptsBuffer = mtlBuffer, ptsbase = entry.begin;
+                break;
+            case Ra::Buffer::kPointPoolBase:
+                ptsBuffer = poolBuffer, ptsbase = 0;
                 break;
             case Ra::Buffer::kInstancesBase:
                 instbase = entry.begin;
@@ -220,7 +227,7 @@
                     [commandEncoder setVertexBuffer:mtlBuffer offset:buffer->ctms atIndex:4];
                     [commandEncoder setVertexBuffer:mtlBuffer offset:instbase atIndex:5];
                     [commandEncoder setVertexBuffer:mtlBuffer offset:buffer->bounds atIndex:7];
-                    [commandEncoder setVertexBuffer:mtlBuffer offset:ptsbase atIndex:8];
+                    [commandEncoder setVertexBuffer:ptsBuffer offset:ptsbase atIndex:8];
                     [commandEncoder setVertexBytes:& width length:sizeof(width) atIndex:10];
                     [commandEncoder setVertexBytes:& height length:sizeof(height) atIndex:11];
                     [commandEncoder setVertexBytes:& buffer->useCurves length:sizeof(bool) atIndex:14];
@@ -18,44 +18,143 @@
 //  3. This notice may not be removed or altered from any source distribution.
 //
 
+#import "RasterizerJobs.hpp"
+#import <chrono>
+
 struct RasterizerRenderer {
+    struct ContextCost {
+        float features[Ra::CostModel::kFeatureCount];  double predicted = 0.0, actual = 0.0;
+    };
+    struct Frame {
+        Ra::Transform view;  Ra::Bounds device;  size_t pathsCount = 0;  bool useCurves = false;  float lodSize = 0.f;
+        std::vector<Ra::Bounds> clips;  std::vector<size_t> divisions;
+    };
     
     void renderList(Ra::SceneList& list, float scale, float w, float h, Ra::Buffer *buffer) {
         Ra::Bounds device(0.f, 0.f, ceilf(scale * w), ceilf(scale * h));
         Ra::Transform view = Ra::Transform(scale, 0.f, 0.f, scale, 0.f, 0.f).concat(list.ctm);
-        
+        uint64_t key = skipRedundantFrames ? fingerprint(list, device, view) : 0;
+        if (key && key == buffer->fingerprint && (buffer->pool.ptr == nullptr || buffer->pool->holds(buffer->poolSlots))) {
+            if (buffer->pool.ptr)
+                buffer->pool->beginFrame(), buffer->pool->touch(buffer->poolSlots);
+            writeColors(list, buffer), skippedFrames++;
+            return;
+        }
+        if (poolPoints && pointPool.ptr == nullptr)
+            pointPool = Ra::Ref<Ra::PointPool>(new Ra::PointPool(pointPoolBytes));
+        buffer->pool = poolPoints ? pointPool : Ra::Ref<Ra::PointPool>(nullptr);
+        if (buffer->pool.ptr)
+            buffer->pool->beginFrame();
+        size_t count = jobs->threadCount() * kContextsPerThread;
+        if (contexts.size() != count)
+            contexts.resize(count), costs.resize(count);
+        assert(!directSegments || !rebasePans);
+        bool retain = rebasePans;
         buffer->useCurves = list.useCurves;
-        buffer->clearColor = list.clearColor;
+        buffer->clearColor = list.clearColor, buffer->trimPolicy = trimPolicy, buffer->compact = compactHeaders, buffer->adaptiveFatlines = adaptiveFatlines;
+        buffer->windows = Ra::reserveSegmentWindows(& contexts[0], count, directSegments && !retain);
         buffer->prepare(list);
-         
-        size_t divisions[kContextCount + 1], *pdivs = divisions;
-        writeBalancedWeightDivisions(list, pdivs);
-        dispatch_apply(kContextCount, DISPATCH_APPLY_AUTO, ^(size_t i) {
-            contexts[i].drawList(list, device, view, pdivs[i], pdivs[i + 1], buffer);
+        if (useSceneTrees)
+            for (auto& scn : list.scenes)
+                if (scn.tree->dirty || scn.tree->count != scn.count)
+                    scn.tree->update(scn);
+        
+        int dx = 0, dy = 0;
+        bool pan = retain && isPan(list, device, view, buffer->useCurves, count, dx, dy);
+        for (auto& ctx : contexts)
+            ctx.retainSpans = retain, ctx.pan = pan, ctx.dx = dx, ctx.dy = dy, ctx.lodSize = lodSize, ctx.trimPolicy = trimPolicy, ctx.jobs = jobs.ptr, ctx.apply = [](void *jobs, size_t count, Ra::Context::Function function, void *info) {
+                ((RasterizerJobs *)jobs)->apply(count, function, info);
+            };
+        std::vector<size_t> divisions(count + 1), begins(count);
+        if (pan)
+            divisions = frame.divisions;
+        else {
+            if (useCostModel)
+                writeCostDivisions(list, device, view, count, & divisions[0]);
+            else
+                writeBalancedWeightDivisions(list, count, & divisions[0]);
+            snapStaticDivisions(list, count, & divisions[0]);
+        }
+        frame.view = view, frame.device = device, frame.pathsCount = list.pathsCount, frame.useCurves = buffer->useCurves, frame.lodSize = lodSize;
+        frame.clips = list.clips, frame.divisions = divisions;
+        jobs->apply(count, [&](size_t i) {
+            auto t0 = std::chrono::steady_clock::now();
+            contexts[i].drawList(list, device, view, divisions[i], divisions[i + 1], buffer);
+            costs[i].actual = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
         });
-        size_t begins[kContextCount], *pbegins = begins, size;
-        size = Ra::resizeBuffer(list, contexts, kContextCount, pbegins, *buffer);
-        dispatch_apply(kContextCount, DISPATCH_APPLY_AUTO, ^(size_t i) {
-            Ra::writeContextToBuffer(list, contexts + i, pbegins[i], *buffer);
+        size_t size = Ra::resizeBuffer(list, & contexts[0], count, & begins[0], *buffer);
+        jobs->apply(count, [&](size_t i) {
+            auto t0 = std::chrono::steady_clock::now();
+            Ra::writeContextToBuffer(list, & contexts[i], begins[i], *buffer);
+            costs[i].actual += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
         });
-        for (int i = 0; i < kContextCount; i++)
-            for (auto entry : contexts[i].entries)
+        if (useCostModel && calibrate && !pan)
+            for (auto& cost : costs)
+                model.calibrate(cost.features, cost.actual);
+        for (auto& ctx : contexts)
+            for (auto entry : ctx.entries)
                 *(buffer->entries.alloc(1)) = entry;
         size_t end = buffer->entries.end == 0 ? 0 : buffer->entries.back().end;
         assert(size >= end);
+        buffer->fingerprint = key;
     }
     
-    void writeBalancedWeightDivisions(Ra::SceneList& list, size_t *divisions) {
+    //  Every input that changes a frame's buffer. A scene is keyed by its version, which addPath, setStatic and invalidate
+    //  renew, so this is linear in scenes, not paths. The settings that change the buffer's layout are keyed too.
+    uint64_t fingerprint(Ra::SceneList& list, Ra::Bounds device, Ra::Transform view) {
+        float values[] = { device.lx, device.ly, device.ux, device.uy, view.a, view.b, view.c, view.d, view.tx, view.ty, lodSize, float(list.useCurves) };
+        size_t settings[] = { compactHeaders, adaptiveFatlines, directSegments, poolPoints, useSceneTrees, trimPolicy.frames, trimPolicy.slack, trimPolicy.minBytes }, key[2];
+        uint64_t h = XXH64(values, sizeof(values), list.pathsCount);
+        h = XXH64(settings, sizeof(settings), h), h = XXH64(& list.clearColor, sizeof(Ra::Colorant), h);
+        h = XXH64(list.ctms.data(), list.ctms.size() * sizeof(Ra::Transform), h);
+        h = XXH64(list.clips.data(), list.clips.size() * sizeof(Ra::Bounds), h);
+        for (auto& scn : list.scenes)
+            key[0] = scn.cache->version, key[1] = scn.count, h = XXH64(key, sizeof(key), h);
+        return h ?: 1;
+    }
+    //  A skipped frame's colors are rewritten, as the consumer may have matched the buffer's colors to its color space.
+    void writeColors(Ra::SceneList& list, Ra::Buffer *buffer) {
+        Ra::Colorant *colors = (Ra::Colorant *)(buffer->base + buffer->colors);
+        if (buffer->compact) {
+            uint32_t *paths = buffer->paths.base, *end = paths + buffer->paths.end;  size_t lz = 0;
+            for (auto& scn : list.scenes)
+                for (lz += scn.count; paths < end && *paths < lz; paths++)
+                    *colors++ = scn.colors->base[*paths - (lz - scn.count)];
+        } else
+            for (auto& scn : list.scenes)
+                memcpy(colors, scn.colors->base, scn.count * sizeof(Ra::Colorant)), colors += scn.count;
+    }
+    //  A pan moves the view by whole device pixels and changes nothing else, so each context can shift its previous output.
+    bool isPan(Ra::SceneList& list, Ra::Bounds device, Ra::Transform view, bool useCurves, size_t count, int& dx, int& dy) {
+        float tx = view.tx - frame.view.tx, ty = view.ty - frame.view.ty;
+        dx = roundf(tx), dy = roundf(ty);
+        return frame.divisions.size() == count + 1 && frame.pathsCount == list.pathsCount && frame.useCurves == useCurves && frame.lodSize == lodSize
+            && memcmp(& frame.device, & device, sizeof(device)) == 0 && fabsf(tx - dx) < 1e-3f && fabsf(ty - dy) < 1e-3f
+            && view.a == frame.view.a && view.b == frame.view.b && view.c == frame.view.c && view.d == frame.view.d
+            && abs(dx) < device.width() && abs(dy) < device.height()
+            && frame.clips.size() == list.clips.size() && memcmp(frame.clips.data(), list.clips.data(), list.clips.size() * sizeof(Ra::Bounds)) == 0;
+    }
+    void snapStaticDivisions(Ra::SceneList& list, size_t divcount, size_t *divisions) {
+        size_t lz, uz, i, j;
+        for (lz = uz = i = 0; i < list.scenes.size(); i++, lz = uz) {
+            uz = lz + list.scenes[i].count;
+            if (list.scenes[i].cache->isStatic)
+                for (j = 1; j < divcount; j++)
+                    if (divisions[j] > lz && divisions[j] < uz)
+                        divisions[j] = divisions[j] - lz < uz - divisions[j] ? lz : uz;
+        }
+    }
+    void writeBalancedWeightDivisions(Ra::SceneList& list, size_t divcount, size_t *divisions) {
         size_t total = 0, count, si, i, iz, target;
         for (int j = 0; j < list.scenes.size(); j++)
             total += list.scenes[j].weight;
         if (total == 0)
-            memset(divisions, 0, (kContextCount + 1) * sizeof(*divisions));
+            memset(divisions, 0, (divcount + 1) * sizeof(*divisions));
         else {
-            divisions[0] = 0, divisions[kContextCount] = list.pathsCount;
+            divisions[0] = 0, divisions[divcount] = list.pathsCount;
             auto scene = & list.scenes[0];
-            for (count = si = iz = 0, i = 1; i < kContextCount; i++) {
-                for (target = total * i / kContextCount; count < target; iz++, si++) {
+            for (count = si = iz = 0, i = 1; i < divcount; i++) {
+                for (target = total * i / divcount; count < target; iz++, si++) {
                     if (si == scene->count)
                         scene++, si = 0;
                     count += scene->paths->base[si]->types.end;
@@ -64,10 +163,50 @@ struct RasterizerRenderer {
             }
         }
     }
-    void reset() { for (auto& ctx : contexts) ctx.reset(); }
+    void writeCostDivisions(Ra::SceneList& list, Ra::Bounds device, Ra::Transform view, size_t divcount, size_t *divisions) {
+        const size_t fcount = Ra::CostModel::kFeatureCount;
+        size_t block = std::max(size_t(1), list.pathsCount / (divcount * kBlocksPerContext)), blocks = (list.pathsCount + block - 1) / block, b, i, j;
+        blockFeatures.resize(blocks * fcount), blockCosts.resize(blocks);
+        jobs->apply(blocks, [&](size_t i) {
+            float *features = & blockFeatures[i * fcount];
+            memset(features, 0, fcount * sizeof(float));
+            Ra::writeCostFeatures(list, device, view, i * block, std::min(list.pathsCount, (i + 1) * block), lodSize, adaptiveFatlines, features);
+            blockCosts[i] = model.cost(features);
+        });
+        float total = 0.f, sum = 0.f, target;
+        for (b = 0; b < blocks; b++)
+            total += blockCosts[b];
+        for (divisions[0] = b = 0, i = 1; i <= divcount; i++) {
+            ContextCost& cost = costs[i - 1];
+            memset(cost.features, 0, sizeof(cost.features));
+            for (target = total * i / divcount; b < blocks && (i == divcount || sum + 0.5f * blockCosts[b] < target); b++) {
+                sum += blockCosts[b];
+                for (j = 0; j < fcount; j++)
+                    cost.features[j] += blockFeatures[b * fcount + j];
+            }
+            divisions[i] = std::min(list.pathsCount, b * block), cost.predicted = model.cost(cost.features);
+        }
+    }
+    void setThreadCount(size_t count) { jobs->start(count), reset(); }
+    void reset() { frame = Frame();  for (auto& ctx : contexts) ctx.reset(); }
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (auto& ctx : contexts)
+            bytes += ctx.residentBytes();
+        return bytes;
+    }
     
-    static const int kContextCount = 8;
-    Ra::Context contexts[kContextCount];
+    static const int kContextsPerThread = 4, kBlocksPerContext = 16;
+    Ra::Ref<RasterizerJobs> jobs;
+    std::vector<Ra::Context> contexts;
+    //  Direct segments are drawn into windows of the buffer rather than copied there. A rebased pan reads the last frame's
+    //  segments from its context, which a window does not keep, so direct segments need rebasePans off, and are asserted against it.
+    //  Pooled points are copied to a point pool shared by every buffer, once for as long as their path stays visible.
+    //  Adaptive fat lines are sized per path by Ra::fatlineHeight, trading edge instances against edge fragments.
+    bool useCostModel = true, calibrate = true, useSceneTrees = true, rebasePans = true, skipRedundantFrames = true, compactHeaders = false, directSegments = false, poolPoints = false, adaptiveFatlines = false;  float lodSize = kLODSize;  Ra::CostModel model;  Ra::TrimPolicy trimPolicy;
+    Ra::Ref<Ra::PointPool> pointPool = Ra::Ref<Ra::PointPool>(nullptr);  size_t pointPoolBytes = kPointPoolBytes;
+    Frame frame;  size_t skippedFrames = 0;
+    std::vector<ContextCost> costs;  std::vector<float> blockFeatures, blockCosts;
  };
 
 
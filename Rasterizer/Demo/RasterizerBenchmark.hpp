@@ -0,0 +1,733 @@
+//
+//  Copyright 2025 Nigel Timothy Barber - nigel@mindbrix.co.uk
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty. In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for personal use
+//  (for a commercial licence please contact the author), and to alter it and
+//  redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//  claim that you wrote the original software. If you use this software
+//  in a product, an acknowledgment in the product documentation would be
+//  appreciated but is not required.
+//  2. Altered source versions must be plainly marked as such, and must not be
+//  misrepresented as being the original software.
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#import "Rasterizer.hpp"
+#import "RasterizerRenderer.hpp"
+#import "RasterizerPDF.hpp"
+#import "RasterizerSVG.hpp"
+#import <chrono>
+#import <thread>
+#import <sys/resource.h>
+
+struct RasterizerBenchmark {
+    constexpr static size_t kWarmupFrames = 2, kFrames = 16, kPanStep = 8;
+
+    static double frameTime(RasterizerRenderer& renderer, Ra::SceneList& list, Ra::Bounds bounds, Ra::Buffer& buffer) {
+        renderer.skipRedundantFrames = false;
+        for (size_t i = 0; i < kWarmupFrames; i++)
+            renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kFrames; i++)
+            renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / kFrames;
+    }
+    static Ra::Transform zoomed(Ra::Transform ctm, Ra::Bounds bounds, float zoom) {
+        return Ra::Transform(zoom, 0.f, 0.f, zoom, bounds.cx() * (1.f - zoom), bounds.cy() * (1.f - zoom)).concat(ctm);
+    }
+    //  Calls sweep with the list zoomed about the center of bounds by each power of 4 from first to last, then restores its ctm
+    template<typename Sweep>
+    static void sweepZooms(Ra::SceneList& list, Ra::Bounds bounds, float first, float last, Sweep sweep) {
+        Ra::Transform ctm = list.ctm;  float step = last < first ? 0.25f : 4.f;
+        for (float zoom = first; last < first ? zoom >= last : zoom <= last; zoom *= step)
+            list.ctm = zoomed(ctm, bounds, zoom), sweep(zoom);
+        list.ctm = ctm;
+    }
+    static void writeThreadScaling(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        size_t count = std::thread::hardware_concurrency() ?: 1;
+        double ms, ms1 = 0.0;
+        fprintf(out, "threads, ms/frame, speedup (%zu paths)\n", list.pathsCount);
+        for (size_t n = 1; n <= count; n++) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            renderer.setThreadCount(n);
+            ms = frameTime(renderer, list, bounds, buffer), ms1 = n == 1 ? ms : ms1;
+            fprintf(out, "%zu, %.3f, %.2f\n", n, ms, ms1 / ms);
+        }
+    }
+    static void writeZoomCulling(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        Ra::SceneList linear = list;
+        for (auto& scn : linear.scenes)
+            scn.tree = Ra::Ref<Ra::Scene::Tree>();
+        fprintf(out, "zoom, linear ms/frame, tree ms/frame, speedup (%zu paths)\n", list.pathsCount);
+        sweepZooms(list, bounds, 1.f, 4096.f, [&](float zoom) {
+            RasterizerRenderer renderer, treeRenderer;  Ra::Buffer buffer;
+            renderer.useSceneTrees = false, linear.ctm = list.ctm;
+            double ms = frameTime(renderer, linear, bounds, buffer), tms = frameTime(treeRenderer, list, bounds, buffer);
+            fprintf(out, "%g, %.3f, %.3f, %.2f\n", zoom, ms, tms, ms / tms);
+        });
+    }
+    static void writeDivisionScaling(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, points, segments, ms\n");
+        sweepZooms(list, bounds, 1.f, 4096.f, [&](float zoom) {
+            Ra::Transform view = list.ctm;
+            Ra::SegmentCounter counter;  size_t points = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < list.scenes.size(); i++) {
+                Ra::Scene& scn = list.scenes[i];  Ra::Transform ctm = view.concat(list.ctms[i]);
+                for (size_t is = 0; is < scn.count; is++) {
+                    Ra::Transform m = ctm.concat(scn.ctms->base[is]);
+                    Ra::Bounds dev = Ra::Bounds(scn.bnds.base[is].quad(m)), clip = dev.integral().intersect(bounds);
+                    if (clip.lx < clip.ux && clip.ly < clip.uy)
+                        points += scn.paths->base[is]->types.end, Ra::divideGeometry(scn.paths->base[is].ptr, m, clip, clip.contains(dev), true, counter);
+                }
+            }
+            fprintf(out, "%g, %zu, %zu, %.3f\n", zoom, points, counter.count, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        });
+    }
+    static void writeLODSavings(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "scale, lodSize, instances, edges, bytes, ms/frame\n");
+        sweepZooms(list, bounds, 1.f, 1.f / 64.f, [&](float scale) {
+            for (float lodSize : { 0.f, 0.5f * kLODSize, kLODSize, 2.f * kLODSize }) {
+                RasterizerRenderer renderer;  Ra::Buffer buffer;  size_t instances = 0, edges = 0, bytes = 0;
+                renderer.lodSize = lodSize;
+                double ms = frameTime(renderer, list, bounds, buffer);
+                for (size_t i = 0; i < buffer.entries.end; i++) {
+                    Ra::Buffer::Entry& entry = buffer.entries.base[i];
+                    if (entry.type == Ra::Buffer::kInstances || entry.type == Ra::Buffer::kOpaques)
+                        instances += (entry.end - entry.begin) / sizeof(Ra::Instance);
+                    else if (entry.type <= Ra::Buffer::kQuadMolecules)
+                        edges += (entry.end - entry.begin) / sizeof(Ra::Edge);
+                    bytes = std::max(bytes, entry.end);
+                }
+                fprintf(out, "%g, %g, %zu, %zu, %zu, %.3f\n", scale, lodSize, instances, edges, bytes, ms);
+            }
+        });
+    }
+    static void writeStaticCache(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        size_t hits = 0, misses = 0;
+        fprintf(out, "static scenes, ms/frame, hits, misses\n");
+        for (int isStatic = 0; isStatic < 2; isStatic++) {
+            Ra::SceneList frame;
+            for (size_t i = 0; i < list.scenes.size(); i++) {
+                Ra::Scene scene = list.scenes[i];
+                scene.cache = Ra::Ref<Ra::Scene::Cache>(), scene.setStatic(isStatic);
+                frame.addScene(scene, list.ctms[i], list.clips[i]);
+            }
+            frame.ctm = list.ctm;
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            double ms = frameTime(renderer, frame, bounds, buffer);
+            for (auto& cache : frame.caches)
+                hits += cache->hits, misses += cache->misses;
+            fprintf(out, "%s, %.3f, %zu, %zu\n", isStatic ? "yes" : "no", ms, hits, misses);
+        }
+    }
+    static void writePanLatency(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        Ra::Transform ctm = list.ctm;
+        fprintf(out, "rebase pans, ms/frame (%zu paths)\n", list.pathsCount);
+        for (int rebasePans = 0; rebasePans < 2; rebasePans++) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            renderer.rebasePans = rebasePans, list.ctm = ctm;
+            renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t i = 1; i <= kFrames; i++) {
+                list.ctm = Ra::Transform(1.f, 0.f, 0.f, 1.f, float(kPanStep * i), float(kPanStep * i)).concat(ctm);
+                renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+            }
+            fprintf(out, "%s, %.3f\n", rebasePans ? "yes" : "no", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / kFrames);
+        }
+        list.ctm = ctm;
+    }
+    static void writeFrameSkipping(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "skip redundant frames, ms/frame, skipped, fingerprint ms\n");
+        for (int skipRedundantFrames = 0; skipRedundantFrames < 2; skipRedundantFrames++) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            renderer.skipRedundantFrames = skipRedundantFrames;
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < kFrames; i++)
+                renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+            auto t1 = std::chrono::steady_clock::now();
+            renderer.fingerprint(list, bounds, list.ctm);
+            auto t2 = std::chrono::steady_clock::now();
+            fprintf(out, "%s, %.3f, %zu, %.3f\n", skipRedundantFrames ? "yes" : "no", std::chrono::duration<double, std::milli>(t1 - t0).count() / kFrames, renderer.skippedFrames, std::chrono::duration<double, std::milli>(t2 - t1).count());
+        }
+    }
+    //  Zooms in, then holds at 1x: resident memory should fall back within a few kTrimFrames, then stop changing. The
+    //  check repeats the run on one thread, at a slack of 2 and no minimum size, which the zooms' growth crosses where the
+    //  defaults may not, against a control whose marks barely decay. It fails unless the last hold ends with no resizes in
+    //  its last kTrimFrames frames, within the slack of the first hold's bytes, and below the control's resident bytes.
+    static void writeMemoryTrace(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        Ra::Transform ctm = list.ctm;
+        float zooms[] = { 1.f, 4.f, 16.f, 64.f, 1.f };  size_t holds[] = { kFrames, kFrames, kFrames, kFrames, 8 * kTrimFrames };
+        auto trace = [&](Ra::TrimPolicy policy, size_t threads, size_t *first, size_t *final, FILE *out) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;  size_t resizes, recent, last, bytes;
+            renderer.skipRedundantFrames = false, renderer.trimPolicy = policy;
+            if (threads)
+                renderer.setThreadCount(threads);
+            for (size_t i = 0; i < sizeof(zooms) / sizeof(*zooms); i++) {
+                list.ctm = zoomed(ctm, bounds, zooms[i]), resizes = recent = last = 0;
+                for (size_t j = 0; j < holds[i]; j++, last = bytes) {
+                    renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+                    bytes = renderer.residentBytes() + buffer.size;
+                    if (j && bytes != last)
+                        resizes++, recent += j + kTrimFrames >= holds[i];
+                }
+                if (i == 0)
+                    first[0] = renderer.residentBytes(), first[1] = buffer.size;
+                if (out)
+                    fprintf(out, "%g, %zu, %.3f, %.3f, %zu, %zu\n", zooms[i], holds[i], renderer.residentBytes() / 1048576.0, buffer.size / 1048576.0, resizes, recent);
+            }
+            final[0] = renderer.residentBytes(), final[1] = buffer.size;
+            return recent == 0 && final[0] <= policy.slack * first[0] && final[1] <= policy.slack * first[1];
+        };
+        Ra::TrimPolicy policy, control;  size_t first[2], final[2], controlFirst[2], controlFinal[2];
+        fprintf(out, "zoom, frames, resident MB, buffer MB, resizes, resizes in last %d frames\n", kTrimFrames);
+        trace(policy, 0, first, final, out);
+        policy.slack = control.slack = 2, policy.minBytes = control.minBytes = 0, control.frames = size_t(1) << 30;
+        bool decayed = trace(policy, 1, first, final, nullptr) && (trace(control, 1, controlFirst, controlFinal, nullptr), final[0] < controlFinal[0]);
+        fprintf(out, "check, first resident MB, last resident MB, last resident MB without decay\n%s, %.3f, %.3f, %.3f\n", decayed ? "pass" : "FAIL", first[0] / 1048576.0, final[0] / 1048576.0, controlFinal[0] / 1048576.0);
+        list.ctm = ctm;
+    }
+    //  Copies and releases a plain and an atomically counted Ref, then renders lists handed over from a builder thread. The
+    //  TSan Rasterizer scheme runs it first under ThreadSanitizer.
+    static void writeRefCounting(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        const size_t kCopies = 1 << 22;
+        Ra::Ref<Ra::Memory<uint8_t>> plain, plains[64];  Ra::Path atomic, atomics[64];
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kCopies; i++)
+            plains[i & 63] = plain;
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kCopies; i++)
+            atomics[i & 63] = atomic;
+        auto t2 = std::chrono::steady_clock::now();
+        fprintf(out, "count, ns/copy\nplain, %.3f\natomic, %.3f\n", std::chrono::duration<double, std::nano>(t1 - t0).count() / kCopies, std::chrono::duration<double, std::nano>(t2 - t1).count() / kCopies);
+        
+        Ra::SceneListHandoff handoff;  std::atomic<bool> done(false);  size_t posted = 0, taken = 0, frames = 0;
+        std::thread builder([&] {
+            for (size_t i = 0; i < kFrames * 4; i++, posted++) {
+                Ra::SceneList built;
+                for (size_t j = 0; j < list.scenes.size(); j++) {
+                    Ra::Scene scene;
+                    for (size_t is = 0; is < list.scenes[j].count; is++)
+                        scene.addPath(list.scenes[j].paths->base[is], list.scenes[j].ctms->base[is], list.scenes[j].colors->base[is], list.scenes[j].widths->base[is], list.scenes[j].flags->base[is], list.scenes[j].clips.base + is);
+                    built.addScene(scene, list.ctms[j], list.clips[j]);
+                }
+                built.ctm = list.ctm, handoff.post(built);
+            }
+            done = true;
+        });
+        RasterizerRenderer renderer;  Ra::Buffer buffer;  Ra::SceneList current;
+        renderer.skipRedundantFrames = false;
+        for (bool finished = false; !finished; ) {
+            finished = done;
+            if (handoff.take(current))
+                taken++;
+            if (current.pathsCount)
+                renderer.renderList(current, 1.f, bounds.width(), bounds.height(), & buffer), frames++;
+        }
+        builder.join();
+        fprintf(out, "handoff: %zu posted, %zu taken, %zu frames\n", posted, taken, frames);
+    }
+    static void writeImportTeardown(Ra::Memory<uint8_t>& svgData, Ra::Memory<uint8_t>& pdfData, size_t pageIndex, FILE *out) {
+        fprintf(out, "document, allocator, import ms, teardown ms, arena bytes\n");
+        for (int useArena = 0; useArena < 2; useArena++) {
+            double importMs = 0.0, teardownMs = 0.0;  size_t bytes = 0;
+            for (size_t i = 0; i < kFrames && (svgData.size || pdfData.size); i++) {
+                Ra::Ref<Ra::Arena> arena = useArena ? Ra::Ref<Ra::Arena>() : Ra::Ref<Ra::Arena>(nullptr);
+                auto t0 = std::chrono::steady_clock::now();
+                Ra::SceneList *document = new Ra::SceneList();
+                if (svgData.size)
+                    document->addScene(RasterizerSVG::createScene(svgData.addr, svgData.size, arena));
+                else
+                    document->addList(RasterizerPDF::writeSceneList(pdfData.addr, pdfData.size, pageIndex, arena));
+                bytes = arena.ptr ? arena->bytes : 0, arena = Ra::Ref<Ra::Arena>(nullptr);
+                auto t1 = std::chrono::steady_clock::now();
+                delete document;
+                auto t2 = std::chrono::steady_clock::now();
+                importMs += std::chrono::duration<double, std::milli>(t1 - t0).count(), teardownMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            }
+            fprintf(out, "%s, %s, %.3f, %.3f, %zu\n", svgData.size ? "svg" : "pdf", useArena ? "arena" : "malloc", importMs / kFrames, teardownMs / kFrames, bytes);
+        }
+    }
+    //  Zooms in on the center, where a full header still holds every path but a compact one only the visible ones
+    static void writeCompactHeaders(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, full header KB, compact header KB, visible paths, full ms/frame, compact ms/frame (%zu paths)\n", list.pathsCount);
+        sweepZooms(list, bounds, 1.f, 256.f, [&](float zoom) {
+            RasterizerRenderer full, compact;  Ra::Buffer fullBuffer, compactBuffer;
+            compact.compactHeaders = true;
+            double fullMs = frameTime(full, list, bounds, fullBuffer), compactMs = frameTime(compact, list, bounds, compactBuffer);
+            fprintf(out, "%g, %.1f, %.1f, %zu, %.3f, %.3f\n", zoom, fullBuffer.headerSize / 1024.0, compactBuffer.headerSize / 1024.0, compactBuffer.pathsCount, fullMs, compactMs);
+        });
+    }
+    //  Grids of small molecule paths viewed at a fixed scale, so the visible work stays constant as the path count grows
+    static void writeSparseUploads(Ra::Bounds bounds, FILE *out) {
+        Ra::Path dot;  dot->addEllipse(Ra::Bounds(0.f, 0.f, 0.8f, 0.8f));
+        fprintf(out, "paths, visible, ms/frame, ms/frame without pan spans\n");
+        for (size_t side = 128; side <= 1024; side *= 2) {
+            Ra::Scene scene;  Ra::SceneList list;  Ra::Colorant black(0, 0, 0, 255);
+            for (size_t y = 0; y < side; y++)
+                for (size_t x = 0; x < side; x++)
+                    scene.addPath(dot, Ra::Transform(1.f, 0.f, 0.f, 1.f, x, y), black, 0.f, 0);
+            list.addScene(scene), list.ctm = Ra::Transform(24.f, 0.f, 0.f, 24.f, 0.f, 0.f);
+            RasterizerRenderer renderer, unspanned;  Ra::Buffer buffer;
+            renderer.compactHeaders = unspanned.compactHeaders = true, unspanned.rebasePans = false;
+            double ms = frameTime(renderer, list, bounds, buffer), unspannedMs = frameTime(unspanned, list, bounds, buffer);
+            fprintf(out, "%zu, %zu, %.3f, %.3f\n", list.pathsCount, buffer.pathsCount, ms, unspannedMs);
+        }
+    }
+    //  Zooms in on the center, comparing the segment bytes each frame copies into the buffer with and without direct segments
+    static void writeDirectSegments(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, segment KB, direct copied KB, ms/frame, direct ms/frame\n");
+        sweepZooms(list, bounds, 1.f, 64.f, [&](float zoom) {
+            RasterizerRenderer copying, direct;  Ra::Buffer copyingBuffer, directBuffer;  size_t segments = 0, copied = 0;
+            copying.rebasePans = direct.rebasePans = false, direct.directSegments = true;
+            double ms = frameTime(copying, list, bounds, copyingBuffer), directMs = frameTime(direct, list, bounds, directBuffer);
+            for (auto& ctx : direct.contexts)
+                segments += ctx.segments.end * sizeof(Ra::Segment), copied += ctx.segmentsInWindow() ? 0 : ctx.segments.end * sizeof(Ra::Segment);
+            fprintf(out, "%g, %.1f, %.1f, %.3f, %.3f\n", zoom, segments / 1024.0, copied / 1024.0, ms, directMs);
+        });
+    }
+    //  Zooms in on the center, comparing the molecule point bytes of a frame with and without the point pool. The counters
+    //  are the last frame's, so a steady view should upload nothing.
+    static void writePointPool(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, uploaded KB, reused KB, copied KB, evicted KB, ms/frame, pooled ms/frame\n");
+        sweepZooms(list, bounds, 1.f, 64.f, [&](float zoom) {
+            RasterizerRenderer copying, pooled;  Ra::Buffer copyingBuffer, pooledBuffer;
+            pooled.poolPoints = true;
+            double ms = frameTime(copying, list, bounds, copyingBuffer), pooledMs = frameTime(pooled, list, bounds, pooledBuffer);
+            Ra::PointPool& pool = *pooled.pointPool.ptr;
+            fprintf(out, "%g, %.1f, %.1f, %.1f, %.1f, %.3f, %.3f\n", zoom, pool.uploaded / 1024.0, pool.reused / 1024.0, pool.copied / 1024.0, pool.evicted / 1024.0, ms, pooledMs);
+        });
+    }
+    //  Zooms in and back out twice, growing and trimming the buffer, and compares the frame time, minor page faults and
+    //  moves of the buffer's base for a heap buffer and one with a reservation
+    static void writeBufferGrowth(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        const char *names[] = { "heap", "mapped", "mapped, huge pages" };
+        Ra::Transform ctm = list.ctm;  const int steps = 24;
+        fprintf(out, "buffer, ms/frame, max ms/frame, faults/frame, moves\n");
+        for (int backend = 0; backend < 3; backend++) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;  double total = 0.0, max = 0.0, ms;  long faults = 0;  struct rusage u0, u1;
+            renderer.skipRedundantFrames = false, renderer.trimPolicy.frames = 8, buffer.reservation = backend ? size_t(1) << 30 : 0, buffer.hugePages = backend == 2;
+            for (int i = 0; i < 4 * steps; i++) {
+                float zoom = powf(64.f, float(steps - abs(i % (2 * steps) - steps)) / steps);
+                list.ctm = zoomed(ctm, bounds, zoom);
+                getrusage(RUSAGE_SELF, & u0);
+                auto t0 = std::chrono::steady_clock::now();
+                renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+                ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                getrusage(RUSAGE_SELF, & u1);
+                total += ms, max = fmax(max, ms), faults += u1.ru_minflt - u0.ru_minflt;
+            }
+            fprintf(out, "%s, %.3f, %.3f, %.1f, %zu\n", names[backend], total / (4 * steps), max, double(faults) / (4 * steps), buffer.moves);
+        }
+        list.ctm = ctm;
+    }
+    //  Writes each zoom's buffer in the compact encoding and decodes it again, counting the segments that moved by more
+    //  than kCompactSegmentError, allowing for float rounding, or lost their curve flag, and any other records that differ
+    static void writeCompactRecords(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, buffer KB, compact KB, segment KB, compact segment KB, instance KB, compact instance KB, segment runs, float segments, max error px, records differing\n");
+        sweepZooms(list, bounds, 1.f, 64.f, [&](float zoom) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;  Ra::Row<uint8_t> compact, decoded;  Ra::Row<Ra::Buffer::Entry> entries, decodedEntries;
+            size_t sizes[4] = { 0, 0, 0, 0 }, runs = 0, floats = 0, differing = 0, count, i, j;  float maxError = 0.f, error;
+            renderer.renderList(list, 1.f, bounds.width(), bounds.height(), & buffer);
+            size_t header = buffer.headerSize - buffer.colors, size = Ra::writeCompactBuffer(buffer, compact, entries), floatSize = header;
+            Ra::readCompactBuffer(compact.base, header, entries, decoded, decodedEntries);
+            differing += memcmp(decoded.base, buffer.base + buffer.colors, header) != 0;
+            for (i = 0; i < buffer.entries.end; i++) {
+                Ra::Buffer::Entry& entry = buffer.entries.base[i], & dst = entries.base[i], & back = decodedEntries.base[i];
+                uint8_t *src = buffer.base + entry.begin, *dec = decoded.base + back.begin;
+                if (entry.type == Ra::Buffer::kInstancesBase) {
+                    for (j = i + 1; j < buffer.entries.end; j++)
+                        if (buffer.entries.base[j].type == Ra::Buffer::kInstances && buffer.entries.base[j].begin == entry.begin)
+                            break;
+                    differing += j == buffer.entries.end || back.begin != decodedEntries.base[j].begin;
+                    continue;
+                }
+                if (entry.type == Ra::Buffer::kPointPoolBase)
+                    continue;
+                floatSize += entry.end - entry.begin;
+                if (back.end - back.begin != entry.end - entry.begin) {
+                    differing++;
+                    continue;
+                }
+                if (entry.type == Ra::Buffer::kSegmentsBase) {
+                    for (Ra::Segment *s = (Ra::Segment *)src, *d = (Ra::Segment *)dec, *end = (Ra::Segment *)(src + entry.end - entry.begin); s < end; s++, d++) {
+                        error = fmaxf(fmaxf(fabsf(d->x0 - s->x0), fabsf(d->y0 - s->y0)), fmaxf(fabsf(d->x1 - s->x1), fabsf(d->y1 - s->y1))), maxError = fmaxf(maxError, error);
+                        differing += (d->ix0 & 1) != (s->ix0 & 1) || error > kCompactSegmentError + 4e-7f * fmaxf(fmaxf(fabsf(s->x0), fabsf(s->y0)), fmaxf(fabsf(s->x1), fabsf(s->y1)));
+                    }
+                    for (uint8_t *run = compact.base + dst.begin; run < compact.base + dst.end; runs++) {
+                        Ra::SegmentFrame *frame = (Ra::SegmentFrame *)run;  count = frame->count & ~Ra::SegmentFrame::kFloats;
+                        floats += frame->count & Ra::SegmentFrame::kFloats ? count : 0;
+                        run += sizeof(Ra::SegmentFrame) + count * (frame->count & Ra::SegmentFrame::kFloats ? sizeof(Ra::Segment) : sizeof(Ra::Segment16));
+                    }
+                    sizes[0] += entry.end - entry.begin, sizes[1] += dst.end - dst.begin;
+                } else if (entry.type == Ra::Buffer::kInstances || entry.type == Ra::Buffer::kOpaques) {
+                    for (Ra::Instance *inst = (Ra::Instance *)src, *d = (Ra::Instance *)dec, *end = (Ra::Instance *)(src + entry.end - entry.begin); inst < end; inst++, d++)
+                        differing += memcmp(d, inst, inst->iz & Ra::Instance::kOutlines ? sizeof(Ra::Instance) : sizeof(Ra::QuadInstance)) != 0;
+                    sizes[2] += entry.end - entry.begin, sizes[3] += dst.end - dst.begin;
+                } else
+                    differing += memcmp(dec, src, entry.end - entry.begin) != 0;
+            }
+            fprintf(out, "%g, %.1f, %.1f, %.1f, %.1f, %.1f, %.1f, %zu, %zu, %.5f, %zu\n", zoom, floatSize / 1024.0, size / 1024.0, sizes[0] / 1024.0, sizes[1] / 1024.0, sizes[2] / 1024.0, sizes[3] / 1024.0, runs, floats, maxError, differing);
+        });
+    }
+    //  Encodes and decodes one entry of segments, checking each run's frame is its own segments' bounds and fits, float
+    //  runs read back exactly, and every segment keeps its curve flag and moves by at most kCompactSegmentError, allowing
+    //  for float rounding. A shift moves the first decoded y1, so a decode outside the bound can be seen to fail.
+    static size_t checkCompactSegments(const char *name, Ra::Segment *src, size_t n, float shift, FILE *out) {
+        Ra::Row<uint8_t> compact, decoded;  Ra::Segment *s, *d;  Ra::Bounds b;
+        size_t runs = 0, floats = 0, failures = 0, count, i = 0, j;  float error, maxError = 0.f;
+        Ra::writeCompactSegments(src, src + n, compact), Ra::readCompactSegments(compact.base, compact.base + compact.end, decoded);
+        d = (Ra::Segment *)decoded.base, failures += decoded.end != n * sizeof(Ra::Segment);
+        if (failures == 0 && n)
+            d->y1 += shift;
+        for (uint8_t *run = compact.base; failures == 0 && run < compact.base + compact.end; runs++, i += count) {
+            Ra::SegmentFrame *frame = (Ra::SegmentFrame *)run;  count = frame->count & ~Ra::SegmentFrame::kFloats;
+            if (count == 0 || i + count > n) {
+                failures++;
+                break;
+            }
+            for (b = Ra::SegmentFrame::bounds(src[i]), j = i + 1; j < i + count; j++)
+                b.extend(Ra::SegmentFrame::bounds(src[j]));
+            if (frame->count & Ra::SegmentFrame::kFloats)
+                floats += count, failures += memcmp(d + i, src + i, count * sizeof(Ra::Segment)) != 0;
+            else
+                failures += frame->ox != b.lx || frame->oy != b.ly || !Ra::SegmentFrame::fits(b);
+            run += sizeof(Ra::SegmentFrame) + count * (frame->count & Ra::SegmentFrame::kFloats ? sizeof(Ra::Segment) : sizeof(Ra::Segment16));
+        }
+        failures += failures == 0 && i != n;
+        for (s = src; failures == 0 && s < src + n; s++, d++) {
+            error = fmaxf(fmaxf(fabsf(d->x0 - s->x0), fabsf(d->y0 - s->y0)), fmaxf(fabsf(d->x1 - s->x1), fabsf(d->y1 - s->y1))), maxError = fmaxf(maxError, error);
+            failures += (d->ix0 & 1) != (s->ix0 & 1) || error > kCompactSegmentError + 4e-7f * fmaxf(fmaxf(fabsf(s->x0), fabsf(s->y0)), fmaxf(fabsf(s->x1), fabsf(s->y1)));
+        }
+        fprintf(out, "%s, %zu, %zu, %zu, %.6f, %zu\n", name, n, runs, floats, maxError, failures);
+        return failures;
+    }
+    //  Encodes and decodes one entry of instances, checking outlines read back whole and quads their quad fields
+    static size_t checkCompactInstances(const char *name, Ra::Instance *src, size_t n, FILE *out) {
+        Ra::Row<uint8_t> compact, decoded;  Ra::Instance *inst, *d;  size_t failures, words;
+        Ra::writeCompactInstances(src, src + n, compact), Ra::readCompactInstances(compact.base, decoded);
+        uint32_t *counts = (uint32_t *)compact.base;  words = counts[0] && counts[1] ? (n + 31) / 32 : 0;
+        failures = decoded.end != n * sizeof(Ra::Instance) || counts[0] + counts[1] != n;
+        for (inst = src, d = (Ra::Instance *)decoded.base; failures == 0 && inst < src + n; inst++, d++)
+            failures += memcmp(d, inst, inst->iz & Ra::Instance::kOutlines ? sizeof(Ra::Instance) : sizeof(Ra::QuadInstance)) != 0;
+        fprintf(out, "%s, %zu, %u, %u, %zu, %zu\n", name, n, counts[1], counts[0], words, failures);
+        return failures;
+    }
+    //  A deterministic check of the compact encoding, independent of the list: runs at the fits limit and one float past
+    //  it, far from the origin and of zero size, an entry split into runs at their own offsets, curve flags on odd and even
+    //  quantized x0 and at a run's right edge, and instances with and without outlines either side of a mask word. A
+    //  decode moved by twice kCompactSegmentError must be rejected. The curve flag sets x0's low bit, so a curve at the
+    //  fits limit starts at its left edge.
+    static void writeCompactCheck(FILE *out) {
+        const float L = 65534.f * kCompactSegmentError, far = 1e5f;  uint32_t seed = 1;  size_t failures = 0, i;
+        auto next = [&](float scale) { return seed = seed * 1664525 + 1013904223, float(seed >> 8) * scale / 16777216.f; };
+        Ra::Segment limit[] = { Ra::Segment(0.f, 0.f, L, L, false), Ra::Segment(0.f, L, L, 0.f, true) };
+        Ra::Segment over[] = { Ra::Segment(0.f, 0.f, nextafterf(L, 2.f * L), 0.f, true) };
+        Ra::Segment distant[] = { Ra::Segment(far, -far, far + L, -far + L, true), Ra::Segment(-far - L, far, -far, far - L, false) };
+        Ra::Segment point[] = { Ra::Segment(3.25f, 7.5f, 3.25f, 7.5f, true), Ra::Segment(3.25f, 7.5f, 3.25f, 7.5f, false) };
+        Ra::Segment line[] = { Ra::Segment(-17.f, 9.75f, -17.f + L, 9.75f, false) };
+        Ra::Row<Ra::Segment> walk, parity;  Ra::Segment *walks = walk.alloc(256), *parities = parity.alloc(64);  float x = 0.f, y;
+        for (i = 0; i < 256; i++, x += next(16.f))
+            y = next(64.f), walks[i] = Ra::Segment(x, y, x + next(8.f), y + next(8.f), i & 1);
+        for (i = 0; i < 63; i++)
+            parities[i] = Ra::Segment(next(100.f), next(100.f), next(100.f), next(100.f), next(1.f) < 0.5f);
+        parities[63] = Ra::Segment(100.f, 0.f, 0.f, 100.f, true);
+        fprintf(out, "segments, count, runs, float segments, max error px, failures\n");
+        failures += checkCompactSegments("fits limit", limit, 2, 0.f, out);
+        failures += checkCompactSegments("past limit", over, 1, 0.f, out);
+        failures += checkCompactSegments("far offset", distant, 2, 0.f, out);
+        failures += checkCompactSegments("zero size", point, 2, 0.f, out);
+        failures += checkCompactSegments("zero height", line, 1, 0.f, out);
+        failures += checkCompactSegments("sub-runs", walks, 256, 0.f, out);
+        failures += checkCompactSegments("curve flags", parities, 64, 0.f, out);
+        failures += checkCompactSegments("rejects moved", walks, 256, 2.f * kCompactSegmentError, out) == 0;
+        Ra::Row<Ra::Instance> instances;  uint32_t *w;
+        auto fill = [&](size_t n, size_t every) {
+            Ra::Instance *insts = (instances.empty(), instances.alloc(n));
+            for (i = 0; i < n; i++) {
+                for (w = (uint32_t *)(insts + i); w < (uint32_t *)(insts + i + 1); w++)
+                    next(1.f), *w = seed;
+                insts[i].iz = (insts[i].iz & ~Ra::Instance::kOutlines) | (every && i % every == 0) * Ra::Instance::kOutlines;
+            }
+            return insts;
+        };
+        fprintf(out, "instances, count, outlines, quads, mask words, failures\n");
+        failures += checkCompactInstances("mixed", fill(40, 3), 40, out);
+        failures += checkCompactInstances("quads only", fill(8, 0), 8, out);
+        failures += checkCompactInstances("outlines only", fill(8, 1), 8, out);
+        failures += checkCompactInstances("one mask word", fill(32, 2), 32, out);
+        fprintf(out, "failures: %zu\n", failures);
+    }
+    //  Estimates the fragments of a frame's edge accumulation the way edges_vertex_main bounds each pair of segments:
+    //  their y extent in the cell, from their leftmost x in the cell to its right. Edge cells are counted by height.
+    static double edgeFragments(RasterizerRenderer& renderer, bool useCurves, size_t *heights) {
+        double fragments = 0.0;  float slx, sly, suy, x0, y0, x1, y1, x2, y2, ax, bx, ay, by, cy, t[2];
+        for (auto& ctx : renderer.contexts)
+            for (Ra::Blend *inst = ctx.blends.base, *end = inst + ctx.blends.end; inst < end; inst++) {
+                if ((inst->iz & (Ra::Instance::kEdge | Ra::Instance::kOutlines | Ra::Instance::kMolecule)) != Ra::Instance::kEdge)
+                    continue;
+                Ra::Cell& cell = inst->quad.cell;  Ra::Segment *base = ctx.segments.base + inst->quad.base;  uint32_t *si = ctx.segmentsIndices.base + inst->data.idx;
+                heights[int(fminf(4.f, fmaxf(0.f, ceilf(log2f(cell.uy - cell.ly)) - 2.f)))]++;
+                for (int j = 0; j < inst->data.count; j += 2) {
+                    slx = cell.ux, sly = FLT_MAX, suy = -FLT_MAX;
+                    for (int k = j; k < j + 2 && k < inst->data.count; k++) {
+                        Ra::Segment& s = base[si[k]];
+                        x0 = s.x0, y0 = s.y0;
+                        if (useCurves && s.ix0 & 1) {
+                            x1 = s.x1, y1 = s.y1, x2 = (& s)[1].x1, y2 = (& s)[1].y1;
+                            ax = x2 - x1, bx = x1 - x0, ax -= bx, bx *= 2.f, ay = y2 - y1, by = y1 - y0, ay -= by, by *= 2.f;
+                            for (int e = 0; e < 2; e++) {
+                                cy = y0 - float(e ? cell.uy : cell.ly);
+                                t[e] = fmaxf(0.f, fminf(1.f, fabsf(ay) < kQuadraticFlatness ? -cy / by : (-by + copysignf(sqrtf(fmaxf(0.f, by * by - 4.f * ay * cy)), y2 - y0)) / ay * 0.5f));
+                            }
+                            if (t[0] != t[1])
+                                slx = fminf(slx, fminf((ax * t[0] + bx) * t[0] + x0, (ax * t[1] + bx) * t[1] + x0));
+                        } else {
+                            x2 = s.x1, y2 = s.y1;
+                            float m = (x2 - x0) / (y2 - y0), c = x0 - m * y0;
+                            slx = fminf(slx, fmaxf(fminf(x0, x2), fminf(m * fmaxf(cell.ly, fminf(cell.uy, y0)) + c, m * fmaxf(cell.ly, fminf(cell.uy, y2)) + c)));
+                        }
+                        sly = fminf(sly, fminf(y0, y2)), suy = fmaxf(suy, fmaxf(y0, y2));
+                    }
+                    fragments += fmaxf(0.f, cell.ux - fmaxf(floorf(slx), cell.lx)) * fmaxf(0.f, fminf(ceilf(suy), cell.uy) - fmaxf(floorf(sly), cell.ly));
+                }
+            }
+        return fragments;
+    }
+    //  Zooms in on the center, comparing fat lines fixed at kfh with ones sized per path by Ra::fatlineHeight: edge
+    //  instances, estimated edge fragments, frame time and the adaptive edge cells by height
+    static void writeFatlineHeights(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        fprintf(out, "zoom, edges, adaptive edges, edge Kpx, adaptive edge Kpx, ms/frame, adaptive ms/frame, adaptive cells 4/8/16/32/64 px\n");
+        sweepZooms(list, bounds, 1.f, 64.f, [&](float zoom) {
+            RasterizerRenderer fixed, adaptive;  Ra::Buffer fixedBuffer, adaptiveBuffer;  size_t heights[2][5] = { { 0 } };
+            fixed.adaptiveFatlines = false, adaptive.adaptiveFatlines = true;
+            double ms = frameTime(fixed, list, bounds, fixedBuffer), adaptiveMs = frameTime(adaptive, list, bounds, adaptiveBuffer);
+            double px = edgeFragments(fixed, list.useCurves, heights[0]), adaptivePx = edgeFragments(adaptive, list.useCurves, heights[1]);
+            size_t *h = heights[1], edges = heights[0][0] + heights[0][1] + heights[0][2] + heights[0][3] + heights[0][4];
+            fprintf(out, "%g, %zu, %zu, %.1f, %.1f, %.3f, %.3f, %zu/%zu/%zu/%zu/%zu\n", zoom, edges, h[0] + h[1] + h[2] + h[3] + h[4], px / 1e3, adaptivePx / 1e3, ms, adaptiveMs, h[0], h[1], h[2], h[3], h[4]);
+        });
+    }
+    //  The row sort writeSegmentRows used before, of packed 16-bit x and index keys, for the row sorting comparison
+    static void packedRadixSort(uint32_t *in, int n, uint32_t lower, uint32_t range, bool single, uint16_t *counts, Ra::Row<uint32_t>& scratch) {
+        range = range < 4 ? 4 : range;
+        uint32_t *tmp = (scratch.empty(), scratch.alloc(n)), mask = range - 1;
+        memset(counts, 0, sizeof(uint16_t) * range);
+        for (int i = 0; i < n; i++)
+            counts[(in[i] - lower) & mask]++;
+        uint64_t *sums = (uint64_t *)counts, sum = 0, count;
+        for (int i = 0; i < range / 4; i++) {
+            count = sums[i], sum += count + (count << 16) + (count << 32) + (count << 48), sums[i] = sum;
+            sum = sum & 0xFFFF000000000000, sum = sum | (sum >> 16) | (sum >> 32) | (sum >> 48);
+        }
+        for (int i = n - 1; i >= 0; i--)
+            tmp[--counts[(in[i] - lower) & mask]] = in[i];
+        if (single)
+            memcpy(in, tmp, n * sizeof(uint32_t));
+        else {
+            memset(counts, 0, sizeof(uint16_t) * 64);
+            for (int i = 0; i < n; i++)
+                counts[(in[i] >> 8) & 0x3F]++;
+            for (uint16_t *src = counts, *dst = src + 1, i = 1; i < 64; i++)
+                *dst++ += *src++;
+            for (int i = n - 1; i >= 0; i--)
+                in[--counts[(tmp[i] >> 8) & 0x3F]] = tmp[i];
+        }
+    }
+    //  Times the list's frames, then sorts rows of random x across a range of clip widths and row sizes with the packed
+    //  radix sort, falling back to std::sort of the 32-bit keys from 65536, and with Ra::radixSort of the 32-bit keys
+    static void writeRowSorting(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        RasterizerRenderer renderer;  Ra::Buffer buffer;
+        fprintf(out, "ms/frame %.3f (%zu paths)\n", frameTime(renderer, list, bounds, buffer), list.pathsCount);
+        fprintf(out, "width, row size, packed/std::sort us/row, radixSort us/row, speedup\n");
+        uint32_t widths[] = { 128, 1024, 4096 }, seed = 1;  size_t sizes[] = { 256, 4096, 32768, 65536, 262144 }, reps;
+        Ra::Row<uint32_t> xs, keys, dst, packed, scratch;  uint16_t counts[256];  uint32_t bits, shift;
+        for (uint32_t width : widths)
+            for (size_t n : sizes) {
+                for (bits = 2; bits < 16 && (1u << bits) <= width; bits++)
+                    ;
+                shift = 32 - bits, xs.empty(), keys.empty();
+                for (uint32_t *x = xs.alloc(n), *key = keys.alloc(n), i = 0; i < n; i++)
+                    seed = seed * 1664525 + 1013904223, x[i] = (seed >> 8) % width, key[i] = x[i] << shift | i;
+                reps = 4194304 / n, packed.empty(), packed.alloc(n), dst.empty(), dst.alloc(n);
+                bool single = width < 256;  uint32_t range = single ? powf(2.f, ceilf(log2f(width + 1.f))) : 256;
+                auto t0 = std::chrono::steady_clock::now();
+                for (size_t r = 0; r < reps; r++) {
+                    if (n < 65536) {
+                        for (size_t i = 0; i < n; i++)
+                            packed.base[i] = xs.base[i] | uint32_t(i << 16);
+                        packedRadixSort(packed.base, int(n), 0, range, single, counts, scratch);
+                    } else
+                        memcpy(dst.base, keys.base, n * sizeof(uint32_t)), std::sort(dst.base, dst.base + n);
+                }
+                double us0 = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / reps;
+                t0 = std::chrono::steady_clock::now();
+                for (size_t r = 0; r < reps; r++)
+                    memcpy(dst.base, keys.base, n * sizeof(uint32_t)), Ra::radixSort(dst.base, n, bits, shift, scratch);
+                double us1 = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / reps;
+                fprintf(out, "%u, %zu, %.1f, %.1f, %.2f\n", width, n, us0, us1, us0 / us1);
+            }
+    }
+    //  Times 4K frames of many medium ellipses, then the binning alone for paths of 1 to 48 fat lines: a Row per fat line
+    //  with all of a path's rows walked and emptied, against one stream binned by Ra::binSamples
+    static void writeSampleBinning(FILE *out) {
+        Ra::Bounds device(0.f, 0.f, 3840.f, 2160.f);  Ra::Path dot;  dot->addEllipse(Ra::Bounds(0.f, 0.f, 1.f, 1.f));
+        Ra::Colorant black(0, 0, 0, 255);  uint32_t seed = 1;
+        fprintf(out, "paths, ms/frame\n");
+        for (size_t count = 256; count <= 4096; count *= 4) {
+            Ra::Scene scene;  Ra::SceneList list;  RasterizerRenderer renderer;  Ra::Buffer buffer;
+            for (size_t i = 0; i < count; i++) {
+                seed = seed * 1664525 + 1013904223;  float r = 260.f + (seed >> 8) % 500, x = (seed >> 4) % 3840, y = (seed >> 12) % 2160;
+                scene.addPath(dot, Ra::Transform(r, 0.f, 0.f, r, x - 0.5f * r, y - 0.5f * r), black, 0.f, 0);
+            }
+            list.addScene(scene);
+            fprintf(out, "%zu, %.3f\n", count, frameTime(renderer, list, device, buffer));
+        }
+        const size_t kPaths = 16384;
+        fprintf(out, "samples/path, row per fat line ms, single stream ms, speedup (%zu paths)\n", kPaths);
+        for (size_t perPath = 16; perPath <= 1024; perPath *= 4) {
+            std::vector<Ra::Row<Ra::Sample>> rows(1 + 2160 / 16);  Ra::Context ctx;
+            Ra::Row<Ra::Sample> samples;  Ra::Row<Ra::Range> paths;  size_t i, iy, iuy;  int sum0 = 0, sum1 = 0;
+            for (i = 0; i < kPaths; i++) {
+                seed = seed * 1664525 + 1013904223, iuy = 1 + (seed >> 8) % 48;
+                size_t n = 1 + (seed >> 16) % (2 * perPath);  Ra::Sample *s = samples.alloc(n), *end = s + n;
+                for (new (paths.alloc(1)) Ra::Range(iuy, n); s < end; s++)
+                    seed = seed * 1664525 + 1013904223, new (s) Ra::Sample(seed % 3840, seed % 3840 + 4.f, 64.f, s - samples.base, (seed >> 20) % iuy);
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            Ra::Sample *s = samples.base;
+            for (Ra::Range *path = paths.base, *end = path + paths.end; path < end; path++) {
+                for (Ra::Sample *last = s + path->end; s < last; s++)
+                    *(rows[s->iy].alloc(1)) = *s;
+                for (iy = 0; iy < path->begin; iy++, rows[iy - 1].empty())
+                    for (i = 0; i < rows[iy].end; i++)
+                        sum0 += rows[iy].base[i].cover;
+            }
+            double ms0 = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            t0 = std::chrono::steady_clock::now(), s = samples.base;
+            for (Ra::Range *path = paths.base, *end = path + paths.end; path < end; path++) {
+                memcpy(ctx.samples.alloc(path->end), s, path->end * sizeof(Ra::Sample)), s += path->end;
+                uint32_t *offsets = Ra::binSamples(path->begin, ctx);
+                for (iy = 0; iy < path->begin; iy++)
+                    for (i = offsets[iy]; i < offsets[iy + 1]; i++)
+                        sum1 += ctx.samples.base[ctx.binned.base[i]].cover;
+                ctx.samples.empty();
+            }
+            double ms1 = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            fprintf(out, "%zu, %.3f, %.3f, %.2f%s\n", perPath, ms0, ms1, ms0 / ms1, sum0 == sum1 ? "" : " (covers differ)");
+        }
+    }
+    static Ra::Path copyPath(Ra::Geometry *g) {
+        Ra::Path copy;  Ra::Row<float> decoded;  float *p = g->decodedPoints(decoded);
+        for (uint8_t *type = g->types.base, *end = type + g->types.end; type < end; )
+            switch (*type) {
+                case Ra::Geometry::kMove:
+                    copy->moveTo(p[0], p[1]), p += 2, type++;
+                    break;
+                case Ra::Geometry::kLine:
+                    copy->lineTo(p[0], p[1]), p += 2, type++;
+                    break;
+                case Ra::Geometry::kQuadratic:
+                    copy->quadTo(p[0], p[1], p[2], p[3]), p += 4, type += 2;
+                    break;
+                case Ra::Geometry::kCubic:
+                    copy->cubicTo(p[0], p[1], p[2], p[3], p[4], p[5]), p += 6, type += 3;
+                    break;
+                case Ra::Geometry::kClose:
+                    copy->close(), p += 2, type++;
+                    break;
+            }
+        return copy;
+    }
+    //  Rebuilds the list from path copies with and without quantized points, then compares storage, frame time and the
+    //  largest device space point error at each zoom of the current view. Quantizing is limited to the largest zoom.
+    static void writeQuantizedStorage(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        float zooms[] = { 1.f, 4.f, 16.f, 64.f };
+        size_t nz = sizeof(zooms) / sizeof(*zooms), k;
+        fprintf(out, "storage, point bytes, geometry bytes, quantized paths, ms/frame");
+        for (k = 0; k < nz; k++)
+            fprintf(out, ", max error px at %gx", zooms[k]);
+        fprintf(out, "\n");
+        for (int quantize = 0; quantize < 2; quantize++) {
+            Ra::SceneList copies;  size_t pointBytes = 0, geometryBytes = 0, quantized = 0;  float maxError = 0.f;
+            for (size_t j = 0; j < list.scenes.size(); j++) {
+                Ra::Scene& src = list.scenes[j];  Ra::Scene scene;  Ra::Transform lm = list.ctms[j];
+                scene.quantize(list.ctm.concat(lm), quantize ? zooms[nz - 1] : 0.f);
+                for (size_t is = 0; is < src.count; is++)
+                    scene.addPath(copyPath(src.paths->base[is].ptr), src.ctms->base[is], src.colors->base[is], src.widths->base[is], src.flags->base[is], src.clips.base + is);
+                for (size_t is = 0; is < scene.count; is++) {
+                    Ra::Geometry *g = scene.paths->base[is].ptr, *o = src.paths->base[is].ptr;
+                    Ra::Row<float> decoded;  float *p = g->decodedPoints(decoded), *q = o->points.base;
+                    Ra::Transform m = list.ctm.concat(list.ctms[j]).concat(scene.ctms->base[is]);
+                    size_t sizes[] = { g->types.end, g->points.end * (g->quantized ? sizeof(uint16_t) : sizeof(float)), g->molecules.end * sizeof(Ra::Bounds), g->p16s.end * sizeof(Ra::Point16), g->p16cnts.end, g->atoms.end * sizeof(Ra::Atom) };
+                    for (size_t size : sizes)
+                        geometryBytes += (size + 15) & ~15;
+                    pointBytes += sizes[1], quantized += g->quantized != nullptr;
+                    for (size_t i = 0; q && i < g->points.end; i += 2) {
+                        float dx = p[i] - q[i], dy = p[i + 1] - q[i + 1];
+                        maxError = fmaxf(maxError, fmaxf(fabsf(dx * m.a + dy * m.c), fabsf(dx * m.b + dy * m.d)));
+                    }
+                }
+                copies.addScene(scene, list.ctms[j], list.clips[j]);
+            }
+            copies.ctm = list.ctm;
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            double ms = frameTime(renderer, copies, bounds, buffer);
+            fprintf(out, "%s, %zu, %zu, %zu, %.3f", quantize ? "16-bit" : "float", pointBytes, geometryBytes, quantized, ms);
+            for (k = 0; k < nz; k++)
+                fprintf(out, ", %.5f", zooms[k] * maxError);
+            fprintf(out, "\n");
+        }
+    }
+    static void writeContextBalance(Ra::SceneList& list, Ra::Bounds bounds, FILE *out) {
+        for (int useCostModel = 0; useCostModel < 2; useCostModel++) {
+            RasterizerRenderer renderer;  Ra::Buffer buffer;
+            renderer.useCostModel = useCostModel;
+            double ms = frameTime(renderer, list, bounds, buffer), sum = 0.0, max = 0.0;
+            fprintf(out, "%s: %.3f ms/frame\ncontext, predicted, actual ms\n", useCostModel ? "cost model" : "weights", ms);
+            for (size_t i = 0; i < renderer.costs.size(); i++) {
+                RasterizerRenderer::ContextCost& cost = renderer.costs[i];
+                sum += cost.actual, max = fmax(max, cost.actual);
+                fprintf(out, "%zu, %.3f, %.3f\n", i, cost.predicted * 1e-6, cost.actual * 1e-6);
+            }
+            fprintf(out, "imbalance (max / mean): %.2f\n", sum ? max * renderer.costs.size() / sum : 0.0);
+        }
+    }
+    //  The benchmarks of the current list, one per run, so each can be picked and run on its own
+    typedef void (*Write)(Ra::SceneList& list, Ra::Bounds bounds, FILE *out);
+    struct Benchmark {
+        const char *name;  Write write;
+    };
+    constexpr static size_t kBenchmarkCount = 21;
+    static const Benchmark *benchmarks() {
+        static const Benchmark table[kBenchmarkCount] = {
+            { "thread scaling", writeThreadScaling },
+            { "context balance", writeContextBalance },
+            { "zoom culling", writeZoomCulling },
+            { "division scaling", writeDivisionScaling },
+            { "LOD savings", writeLODSavings },
+            { "static cache", writeStaticCache },
+            { "pan latency", writePanLatency },
+            { "frame skipping", writeFrameSkipping },
+            { "memory trace", writeMemoryTrace },
+            { "ref counting", writeRefCounting },
+            { "quantized storage", writeQuantizedStorage },
+            { "compact headers", writeCompactHeaders },
+            { "sparse uploads", [](Ra::SceneList& list, Ra::Bounds bounds, FILE *out) { writeSparseUploads(bounds, out); } },
+            { "direct segments", writeDirectSegments },
+            { "point pool", writePointPool },
+            { "buffer growth", writeBufferGrowth },
+            { "compact records", writeCompactRecords },
+            { "compact check", [](Ra::SceneList& list, Ra::Bounds bounds, FILE *out) { writeCompactCheck(out); } },
+            { "row sorting", writeRowSorting },
+            { "sample binning", [](Ra::SceneList& list, Ra::Bounds bounds, FILE *out) { writeSampleBinning(out); } },
+            { "fatline heights", writeFatlineHeights },
+        };
+        return table;
+    }
+};
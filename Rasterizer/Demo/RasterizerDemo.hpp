@@ -24,13 +24,14 @@
 #import "RasterizerFont.hpp"
 #import "Concentrichron.hpp"
 #import "RasterizerWinding.hpp"
+#import "RasterizerBenchmark.hpp"
 
 
 struct RasterizerDemo {
     constexpr static float kHudWidth = 240, kHudHeight = 240, kHudInset = 20, kHudBorder = 0.5;
     constexpr static size_t kHudItemCount = 11;
     
-    enum KeyCode { kA = 0, kC = 8, kF = 3, kG = 5, kH = 4, kI = 34, kL = 37, kO = 31, kP = 35, kS = 1, kT = 17, k1 = 18, k0 = 29, kMinus = 27, kPlus = 24 };
+    enum KeyCode { kA = 0, kB = 11, kC = 8, kF = 3, kG = 5, kH = 4, kI = 34, kL = 37, kO = 31, kP = 35, kS = 1, kT = 17, k1 = 18, k0 = 29, kMinus = 27, kPlus = 24 };
     enum Flags { kCapsLock = 1 << 16, kShift = 1 << 17, kControl = 1 << 18, kOption = 1 << 19, kCommand = 1 << 20, kNumericPad = 1 << 21, kHelp = 1 << 22, kFunction = 1 << 23 };
     
     struct HudItem {
@@ -52,6 +53,15 @@ struct RasterizerDemo {
         HudItem("T", "Time"),
     };
     
+    //  The benchmark B runs first, named by RASTERIZER_BENCHMARK, e.g. "ref counting" in the TSan Rasterizer scheme
+    static size_t firstBenchmark() {
+        const char *name = getenv("RASTERIZER_BENCHMARK");
+        for (size_t i = 0; name && i < RasterizerBenchmark::kBenchmarkCount; i++)
+            if (strcmp(name, RasterizerBenchmark::benchmarks()[i].name) == 0)
+                return i;
+        return 0;
+    }
+    
 #pragma mark - Event handlers
 
     void onPaste(const char *string, Ra::Bounds bounds) {
@@ -72,6 +82,16 @@ struct RasterizerDemo {
         bool keyUsed = false;
         if (keyCode == KeyCode::kA)
             animating = !animating, clock = 0.0, keyUsed = true;
+        else if (keyCode == KeyCode::kB) {
+            //  Each press runs the next benchmark, the last being the import teardown, so the UI stalls for one at a time
+            list.ctm = ctm;
+            if (benchmarkIndex < RasterizerBenchmark::kBenchmarkCount) {
+                const RasterizerBenchmark::Benchmark& benchmark = RasterizerBenchmark::benchmarks()[benchmarkIndex];
+                fprintf(stderr, "%s\n", benchmark.name), benchmark.write(list, bounds, stderr);
+            } else
+                fprintf(stderr, "import teardown\n"), RasterizerBenchmark::writeImportTeardown(svgData, pdfData, pageIndex, stderr);
+            benchmarkIndex = (benchmarkIndex + 1) % (RasterizerBenchmark::kBenchmarkCount + 1), keyUsed = true;
+        }
         else if (keyCode == KeyCode::kC)
             useCurves = !useCurves, keyUsed = true;
         else if (keyCode == KeyCode::kF) {
@@ -220,11 +240,11 @@ struct RasterizerDemo {
             list.addList(concentrichron.writeList(font));
         } else if (svgData.size) {
             if (document.pathsCount == 0)
-                document.addScene(RasterizerSVG::createScene(svgData.addr, svgData.size)), fit = true;
+                document.addScene(RasterizerSVG::createScene(svgData.addr, svgData.size, Ra::Ref<Ra::Arena>(), kQuantizedScale)), fit = true;
             list.addList(document);
         } else if (pdfData.size) {
             if (document.pathsCount == 0)
-                document.addList(RasterizerPDF::writeSceneList(pdfData.addr, pdfData.size, pageIndex)), fit = true;
+                document.addList(RasterizerPDF::writeSceneList(pdfData.addr, pdfData.size, pageIndex, Ra::Ref<Ra::Arena>(), kQuantizedScale)), fit = true;
             list.addList(document);
         }
         runTransferFunction(list, transferFunction, this);
@@ -283,7 +303,7 @@ struct RasterizerDemo {
     Ra::SceneList list, document, pasted, text;
     Ra::Memory<char> pastedString;
     bool showGlyphGrid = false, showTime = false, showHud = true;
-    size_t pageCount, pageIndex;
+    size_t pageCount, pageIndex, benchmarkIndex = firstBenchmark();
     Ra::Memory<uint8_t> pdfData, svgData;
     
     Ra::Transform ctm;
@@ -313,6 +333,7 @@ struct RasterizerDemo {
             dispatch_apply(threads, DISPATCH_APPLY_AUTO, ^(size_t i) {
                 (*function)(divisions[i], divisions[i + 1], si, scn, ctm, info);
             });
+            scn->invalidate();
         }
     }
     
@@ -26,15 +26,37 @@
 #define kFatMask 0xFFFFFFF0
 #define kfh 16.f
 #define krfh 0.0625f
+#define kMinFatline 4.f
+#define kMaxFatline 64.f
+#define kEdgeInstanceFragments 256.f
 #define kStripHeight 8.f
+#define kAdaptiveStripHeight 4.f
 #define kStripCount 8
+#define kBandFatlines 8
+#define kMinBandSegments 4096
+#define kRadixBits 11
 #define kMoleculesHeight 256
+#define kTreeLeafPaths 32
+#define kTreeFanout 8
 #define kMoleculesRange 32767.f
+#define kQuantizedRange 65535.f
+#define kQuantizedScale 64.f
+#define kQuantizedError 0.03125f
+#define kCompactSegmentError 0.0078125f
 #define kFastSegments 4
 #define kNullIndex 0xFFFF
 #define kPathIndexMask 0xFFFFFF
 #define kMinUpperDet 16.f
+#define kLODSize 1.f
+#define kEvenOddSubpaths 256
 #define kPageSize 4096
+#define kHugePageSize 2097152
+#define kArenaBlockSize 262144
+#define kTrimFrames 60
+#define kTrimSlack 4
+#define kTrimMinBytes 65536
+#define kPointPoolBytes 33554432
+#define kPointPoolFrames 3
 #define kMiterLimit 1.5
 #define kCubicSolverLimit 5e-2f
 #define kDepthRange 0.1f
@@ -20,6 +20,10 @@
 
 #import "Rasterizer.h"
 #import "xxhash.h"
+#import <atomic>
+#import <map>
+#import <mutex>
+#import <sys/mman.h>
 #import <unordered_map>
 #import <vector>
 #pragma clang diagnostic ignored "-Wcomma"
@@ -124,43 +128,92 @@ struct Rasterizer {
         Transform t;
         Type type;
     };
-    template<typename T>
+    //  Reference count policies. A type shared between threads declares an atomic refCount, and Ref picks the policy from it.
+    struct PlainCount {
+        typedef size_t Type;
+        template<typename C> static inline void retain(C& count) { count++; }
+        template<typename C> static inline bool release(C& count) { return --count == 0; }
+    };
+    struct AtomicCount {
+        typedef std::atomic<size_t> Type;
+        static inline void retain(Type& count) { count.fetch_add(1, std::memory_order_relaxed); }
+        static inline bool release(Type& count) { return count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+    };
+    template<typename C> struct CountPolicy { typedef PlainCount Policy; };
+    template<typename C> struct CountPolicy<std::atomic<C>> { typedef AtomicCount Policy; };
+    
+    template<typename T, typename Count = typename CountPolicy<decltype(T::refCount)>::Policy>
     struct Ref {
         Ref()                               { ptr = new T(), ptr->refCount = 1; }
-        ~Ref()                              { if (--(ptr->refCount) == 0) delete ptr; }
+        Ref(std::nullptr_t)                 {}
+        explicit Ref(T *p) : ptr(p)         { Count::retain(ptr->refCount); }
+        ~Ref()                              { if (ptr && Count::release(ptr->refCount)) delete ptr; }
         Ref(const Ref& other)               { *this = other; }
         Ref& operator= (const Ref& other)   {
             if (this != & other) {
                 if (ptr)
                     this->~Ref();
-                ptr = other.ptr, ptr->refCount++;
+                if ((ptr = other.ptr))
+                    Count::retain(ptr->refCount);
             }
             return *this;
         }
         T* operator->() const { return ptr; }
         T *ptr = nullptr;
     };
-    template<typename T>
+    template<typename T, typename Count = PlainCount>
     struct Memory {
         ~Memory() {
-            if (addr)
-                free(addr);
+            free(borrowed ? spare : addr);
         }
         T *resize(size_t n) {
+            if (borrowed)
+                addr = spare, spare = nullptr, borrowed = false;
             size = n, addr = (T *)realloc(addr, n * sizeof(T));
             return addr;
         }
-        size_t refCount, size = 0;  T *addr = nullptr;
+        //  A lent window replaces addr until the memory is resized or the window is returned, and its own allocation is kept as spare
+        void lend(T *window, size_t n) {
+            if (!borrowed)
+                spare = addr, spareSize = size, borrowed = true;
+            addr = window, size = n;
+        }
+        void reclaim() {
+            if (borrowed)
+                addr = spare, size = spareSize, spare = nullptr, borrowed = false;
+        }
+        typename Count::Type refCount;  size_t size = 0, spareSize = 0, peak = 0, mark = 0;  T *addr = nullptr, *spare = nullptr;  bool borrowed = false;
     };
-    template<typename T>
+    //  Scratch memory is kept between frames, but memory that has stayed over slack times a decaying high-water mark of its
+    //  use is shrunk to 1.5 times the mark. The mark follows use up at once and down over roughly frames frames.
+    struct TrimPolicy {
+        bool shrinks(size_t& mark, size_t used, size_t capacity, size_t stride = 1) const {
+            if (frames == 0)
+                return false;
+            mark = used >= mark ? used : mark - (mark - used + frames - 1) / frames;
+            return capacity * stride > minBytes && capacity > slack * mark;
+        }
+        size_t frames = kTrimFrames, slack = kTrimSlack, minBytes = kTrimMinBytes;
+    };
+    //  A row allocates its memory on first use. A base it does not own, e.g. a frozen geometry's block or a window it has
+    //  borrowed, is copied out when it grows, into the row's own memory.
+    template<typename T, typename Count = PlainCount>
     struct Row {
         inline T *alloc(size_t n) {
             size_t begin = end;
             end += n;
-            if (memory->size < end)
-                base = memory->resize(end * 1.5);
+            if (memory.ptr == nullptr || memory->size < end)
+                grow(begin);
             return base + begin;
         }
+        void grow(size_t begin) {
+            if (memory.ptr == nullptr)
+                memory = Ref<Memory<T, Count>>();
+            T *src = base == memory->addr && !memory->borrowed ? nullptr : base;
+            base = memory->resize(end * 1.5);
+            if (src && begin)
+                memcpy(base, src, begin * sizeof(T));
+        }
         inline T *prealloc(size_t n) {
             size_t begin = end;
             alloc(n), end = begin;
@@ -170,19 +223,62 @@ struct Rasterizer {
             return (T*)memset(alloc(n), 0, n * sizeof(T));
         }
         inline T& back() { return base[end - 1]; }
-        Row<T>& empty() { end = idx = 0; return *this; }
-        void reset() { end = idx = 0, base = nullptr, memory = Ref<Memory<T>>(); }
+        Row& empty() {
+            if (memory.ptr && memory->peak < end)
+                memory->peak = end;
+            end = idx = 0;
+            return *this;
+        }
+        //  Called once a frame, after the row's last use
+        void trim(const TrimPolicy& policy) {
+            if (memory.ptr == nullptr || base != memory->addr || memory->borrowed)
+                return;
+            size_t used = memory->peak > end ? memory->peak : end, n;
+            memory->peak = 0;
+            if (policy.shrinks(memory->mark, used, memory->size, sizeof(T))) {
+                if ((n = memory->mark))
+                    base = memory->resize(n + n / 2);
+                else
+                    memory = Ref<Memory<T, Count>>(nullptr), base = nullptr;
+            }
+        }
+        size_t bytes() const { return memory.ptr ? (memory->borrowed ? memory->spareSize : memory->size) * sizeof(T) : 0; }
+        void reset() { end = idx = 0, base = nullptr, memory = Ref<Memory<T, Count>>(nullptr); }
+        //  Writes go to the n elements at addr until the row outgrows them
+        void borrow(T *addr, size_t n) {
+            if (memory.ptr == nullptr)
+                memory = Ref<Memory<T, Count>>();
+            memory->lend(addr, n), base = addr, end = idx = 0;
+        }
+        void reclaim() {
+            if (memory.ptr)
+                memory->reclaim(), base = memory->addr, end = idx = 0;
+        }
         
-        T *base = nullptr;  Ref<Memory<T>> memory;  size_t end = 0, idx = 0;
+        T *base = nullptr;  Ref<Memory<T, Count>> memory = Ref<Memory<T, Count>>(nullptr);  size_t end = 0, idx = 0;
+    };
+    //  Carves 64-byte aligned storage from large blocks and frees them all at once when the last reference goes. Import code
+    //  gives one to a document's scenes, and each geometry frozen into it holds a reference, so shared paths outlive the document.
+    struct Arena {
+        ~Arena() {
+            for (uint8_t *block : blocks)
+                free(block);
+        }
+        uint8_t *alloc(size_t n) {
+            uint8_t *block;
+            n = (n + 63) & ~size_t(63), bytes += n;
+            if (n > kArenaBlockSize / 4)
+                return posix_memalign((void **)& block, 64, n), blocks.emplace_back(block), block;
+            if (end + n > kArenaBlockSize)
+                posix_memalign((void **)& base, 64, kArenaBlockSize), blocks.emplace_back(base), end = 0;
+            return end += n, base + end - n;
+        }
+        AtomicCount::Type refCount;  size_t bytes = 0, end = kArenaBlockSize;  uint8_t *base = nullptr;  std::vector<uint8_t *> blocks;
     };
     struct Range {
         Range(size_t begin, size_t end) : begin(int(begin)), end(int(end)) {}
         int begin, end;
     };
-    struct Index {
-        uint16_t x, i;
-        inline bool operator< (const Index& other) const { return x < other.x; }
-    };
     struct GeometryWriter {
         virtual void writeSegment(float x0, float y0, float x1, float y1) = 0;
         virtual void Quadratic(float x0, float y0, float x1, float y1, float x2, float y2) = 0;
@@ -226,6 +322,7 @@ struct Rasterizer {
     
     struct Geometry {
         enum Type { kMove, kLine, kQuadratic, kCubic, kClose, kCountSize };
+        ~Geometry() { if (block && arena.ptr == nullptr) free(block); }
 
         void prealloc(size_t count) {
             points.prealloc(2 * count), types.prealloc(count);
@@ -290,6 +387,9 @@ struct Rasterizer {
         
         void update(Type type, size_t size, float *p) {
             counts[type]++;  memset(types.alloc(size), type, size);
+            float *q = type == kClose ? points.base + points.idx : p;
+            for (int i = 0; type != kMove && i < size; i++)
+                travelx += fabsf(q[i * 2] - p[i * 2 - 2]), travely += fabsf(q[i * 2 + 1] - p[i * 2 - 1]);
             for (int i = 0; i < size; i++)
                 molecules.back().extend(p[i * 2], p[i * 2 + 1]);
             bounds.extend(molecules.back());
@@ -308,6 +408,50 @@ struct Rasterizer {
             validate();
             return types.end > 1 && *types.base == Geometry::kMove && (bounds.lx != bounds.ux || bounds.ly != bounds.uy);
         }
+        float signedArea() const {
+            return signedArea(0, types.end);
+        }
+        //  The signed area of types [begin, end), begin being a move
+        float signedArea(size_t begin, size_t end) const {
+            double area2 = 0.0, sx = 0.0, sy = 0.0, x0 = 0.0, y0 = 0.0, x1, y1, x2, y2, x3, y3;  float *p = points.base + 2 * begin;
+            for (uint8_t *type = types.base + begin, *last = types.base + end; type < last; )
+                switch (*type) {
+                    case kMove:
+                        area2 += x0 * sy - sx * y0, sx = x0 = p[0], sy = y0 = p[1], p += 2, type++;
+                        break;
+                    case kLine:
+                        x1 = p[0], y1 = p[1], area2 += x0 * y1 - x1 * y0, x0 = x1, y0 = y1, p += 2, type++;
+                        break;
+                    case kQuadratic:
+                        x1 = p[0], y1 = p[1], x2 = p[2], y2 = p[3], p += 4, type += 2;
+                        area2 += (2.0 * (x0 * y1 - x1 * y0 + x1 * y2 - x2 * y1) + x0 * y2 - x2 * y0) / 3.0, x0 = x2, y0 = y2;
+                        break;
+                    case kCubic:
+                        x1 = p[0], y1 = p[1], x2 = p[2], y2 = p[3], x3 = p[4], y3 = p[5], p += 6, type += 3;
+                        area2 += (6.0 * (x0 * y1 - x1 * y0) + 3.0 * (x0 * y2 - x2 * y0) + x0 * y3 - x3 * y0
+                                  + 3.0 * (x1 * y2 - x2 * y1) + 3.0 * (x1 * y3 - x3 * y1) + 6.0 * (x2 * y3 - x3 * y2)) / 10.0, x0 = x3, y0 = y3;
+                        break;
+                    case kClose:
+                        p += 2, type++;
+                        break;
+                }
+            return 0.5 * (area2 + x0 * sy - sx * y0);
+        }
+        //  The area filled by the even-odd rule, taking a subpath inside the molecule of a larger one as a hole in it, one inside
+        //  that as an island, and so on. Past kEvenOddSubpaths, or without a molecule per subpath, the subpath areas are summed
+        float nestedArea() const {
+            Row<float> areas;  size_t begin = 0, i, j, depth;  float area = 0.f;
+            for (i = 1; i <= types.end; i++)
+                if (i == types.end || types.base[i] == kMove)
+                    *areas.alloc(1) = fabsf(signedArea(begin, i)), begin = i;
+            bool nested = areas.end <= kEvenOddSubpaths && molecules.end == areas.end;
+            for (i = 0; i < areas.end; i++) {
+                for (depth = j = 0; nested && j < areas.end; j++)
+                    depth += areas.base[j] > areas.base[i] && molecules.base[j].contains(molecules.base[i]);
+                area += depth & 1 ? -areas.base[i] : areas.base[i];
+            }
+            return fabsf(area);
+        }
         size_t upperBound(float det) const {
             float s = sqrtf(sqrtf(det < 1e-2f ? 1e-2f : det));
             size_t cubics = cubicSums == 0 ? 0 : (det < 1.f ? ceilf(s * (cubicSums + 2.f)) : ceilf(s) * cubicSums);
@@ -317,8 +461,69 @@ struct Rasterizer {
             xxhash = xxhash ?: XXH64(points.base, points.end * sizeof(float), XXH64(types.base, types.end * sizeof(uint8_t), 0));
             return xxhash;
         }
-        size_t refCount, xxhash = 0, minUpper = 0, cubicSums = 0, counts[kCountSize] = { 0, 0, 0, 0, 0 };
-        float x0 = 0.f, y0 = 0.f, maxCurve = 0.f;  Row<uint8_t> types;  Row<float> points;
+        //  Moves the rows into one exactly sized, cache line aligned block, in the order divideGeometry and the molecule
+        //  upload read them, and releases their own memory, so a frozen geometry is two heap blocks however small it is.
+        //  A row that grows again is copied back out of the block. With an arena, the block is carved from it.
+        //  Quantizing stores each point as 16-bit offsets within its molecule bounds, which divideGeometry decodes as part
+        //  of its transform. The error is at most 1/131070 of the molecule's extent, and the points can no longer change.
+        //  A quantizeScale of 0 keeps floats, as does a subpath whose error would exceed kQuantizedError pixels at that scale.
+        void freeze(Ref<Arena> arena = Ref<Arena>(nullptr), float quantizeScale = 0.f) {
+            if (block)
+                return;
+            bool quantize = quantizeScale > 0.f && molecules.end == counts[kMove] && points.end == 2 * types.end && quantizedError(quantizeScale) <= kQuantizedError;
+            size_t sizes[] = { types.end * sizeof(uint8_t), points.end * (quantize ? sizeof(uint16_t) : sizeof(float)), molecules.end * sizeof(Bounds), p16s.end * sizeof(Point16), p16cnts.end * sizeof(uint8_t), atoms.end * sizeof(Atom) };
+            size_t count = sizeof(sizes) / sizeof(*sizes), offsets[count], total = 0, i;
+            for (i = 0; i < count; i++)
+                offsets[i] = total, total += (sizes[i] + 15) & ~15;
+            if ((this->arena = arena).ptr)
+                block = arena->alloc(total ?: 16);
+            else
+                posix_memalign((void **)& block, 64, total ?: 16);
+            freezeRow(types, block + offsets[0]), freezeRow(molecules, block + offsets[2]);
+            freezeRow(p16s, block + offsets[3]), freezeRow(p16cnts, block + offsets[4]), freezeRow(atoms, block + offsets[5]);
+            if (quantize)
+                quantizePoints((uint16_t *)(block + offsets[1])), points.memory = Ref<Memory<float>>(nullptr), points.base = nullptr;
+            else
+                freezeRow(points, block + offsets[1]);
+        }
+        //  The largest quantizing error, in pixels at scale
+        float quantizedError(float scale) const {
+            float extent = 0.f;
+            for (Bounds *b = molecules.base, *end = b + molecules.end; b < end; b++)
+                extent = fmaxf(extent, fmaxf(b->ux - b->lx, b->uy - b->ly));
+            return 0.5f * extent * scale / kQuantizedRange;
+        }
+        void quantizePoints(uint16_t *dst) {
+            float *p = points.base, sx = 0.f, sy = 0.f;  Bounds *b = molecules.base - 1;
+            for (uint8_t *type = types.base, *end = type + types.end; type < end; type++, p += 2) {
+                if (*type == kMove)
+                    b++, sx = b->ux > b->lx ? kQuantizedRange / (b->ux - b->lx) : 0.f, sy = b->uy > b->ly ? kQuantizedRange / (b->uy - b->ly) : 0.f;
+                *dst++ = uint16_t(fminf(kQuantizedRange, fmaxf(0.f, (p[0] - b->lx) * sx + 0.5f)));
+                *dst++ = uint16_t(fminf(kQuantizedRange, fmaxf(0.f, (p[1] - b->ly) * sy + 0.5f)));
+            }
+            quantized = (uint16_t *)(dst - points.end);
+        }
+        //  The points as floats, decoded into dst for a quantized geometry
+        float *decodedPoints(Row<float>& dst) const {
+            if (quantized == nullptr)
+                return points.base;
+            float *pts = dst.alloc(points.end), *p = pts, sx = 0.f, sy = 0.f;  uint16_t *q = quantized;  Bounds *b = molecules.base - 1;
+            for (uint8_t *type = types.base, *end = type + types.end; type < end; type++, p += 2, q += 2) {
+                if (*type == kMove)
+                    b++, sx = (b->ux - b->lx) / kQuantizedRange, sy = (b->uy - b->ly) / kQuantizedRange;
+                p[0] = q[0] * sx + b->lx, p[1] = q[1] * sy + b->ly;
+            }
+            return pts;
+        }
+        template<typename T>
+        static void freezeRow(Row<T>& row, uint8_t *dst) {
+            if (row.end)
+                memcpy(dst, row.base, row.end * sizeof(T));
+            row.memory = Ref<Memory<T>>(nullptr), row.base = (T *)dst;
+        }
+        uint8_t *block = nullptr;  uint16_t *quantized = nullptr;  Ref<Arena> arena = Ref<Arena>(nullptr);
+        AtomicCount::Type refCount;  size_t xxhash = 0, minUpper = 0, cubicSums = 0, counts[kCountSize] = { 0, 0, 0, 0, 0 };
+        float x0 = 0.f, y0 = 0.f, maxCurve = 0.f, area = 0.f, evenOddArea = 0.f, travelx = 0.f, travely = 0.f;  Row<uint8_t> types;  Row<float> points;
         Bounds bounds;  Row<Bounds> molecules;
         Row<Point16> p16s;  Row<uint8_t> p16cnts;  Row<Atom> atoms;
     };
@@ -374,27 +579,114 @@ struct Rasterizer {
         Row<Point16> *p16s;   Row<uint8_t> *p16cnts;  Row<Atom> *atoms;
     };
     
+    struct Segment;  struct Instance;  struct Blend;  struct Upload;
+    
     struct Scene {
         template<typename T>
         struct Vector {
-            uint64_t refCount;  T *base;  std::vector<T> dst;
+            AtomicCount::Type refCount;  T *base;  std::vector<T> dst;
             void add(T obj) {  dst.emplace_back(obj), base = & dst[0]; }
         };
         template<typename T>
         struct RowPair {
-            uint64_t refCount;  T *base;  Row<T> src, dst;
+            AtomicCount::Type refCount;  T *base;  Row<T> src, dst;
             void add(T obj) {  *src.alloc(1) = obj, *dst.alloc(1) = obj, base = dst.base;  }
         };
+        //  Bounds of consecutive runs of kTreeLeafPaths paths, grouped kTreeFanout at a time, so walking the tree visits
+        //  paths in z order. Rebuilt when paths are added or the scene is invalidated, and ignored until then.
+        struct Tree {
+            struct Node {
+                Bounds bounds;  float scale = 0.f, hairline = 0.f;
+            };
+            void update(Scene& scene) {
+                count = scene.count, dirty = false, levels.resize(0);
+                if (count < 2 * kTreeLeafPaths)
+                    return;
+                levels.emplace_back((count + kTreeLeafPaths - 1) / kTreeLeafPaths);
+                Transform *m = scene.ctms->base;  Bounds *b = scene.bnds.base;  float *w = scene.widths->base;
+                for (size_t i = 0; i < count; i++, m++, b++, w++) {
+                    Node& node = levels[0][i / kTreeLeafPaths];
+                    node.bounds.extend(Bounds(b->quad(*m)));
+                    if (*w > 0.f)
+                        node.scale = fmaxf(node.scale, *w * sqrtf(fabsf(m->a * m->d - m->b * m->c)));
+                    else
+                        node.hairline = fmaxf(node.hairline, -*w);
+                }
+                while (levels.back().size() > 1) {
+                    std::vector<Node>& lower = levels.back();
+                    std::vector<Node> upper((lower.size() + kTreeFanout - 1) / kTreeFanout);
+                    for (size_t i = 0; i < lower.size(); i++) {
+                        Node& node = upper[i / kTreeFanout];
+                        node.bounds.extend(lower[i].bounds), node.scale = fmaxf(node.scale, lower[i].scale), node.hairline = fmaxf(node.hairline, lower[i].hairline);
+                    }
+                    levels.emplace_back(std::move(upper));
+                }
+            }
+            void writeVisibleRanges(size_t level, size_t begin, size_t end, Transform ctm, float scale, Bounds clip, size_t li, size_t ui, Row<Range>& ranges) {
+                size_t span = kTreeLeafPaths, i, lp, up;  float e;
+                for (i = 0; i < level; i++)
+                    span *= kTreeFanout;
+                for (i = begin; i < end; i++) {
+                    Node& node = levels[level][i];
+                    lp = i * span, up = lp + span < count ? lp + span : count;
+                    if (up <= li || lp >= ui || node.bounds.lx > node.bounds.ux)
+                        continue;
+                    Bounds dev = Bounds(node.bounds.quad(ctm));
+                    e = 1.f + node.scale * scale + node.hairline + 1e-5f * fmaxf(fmaxf(fabsf(dev.lx), fabsf(dev.ux)), fmaxf(fabsf(dev.ly), fabsf(dev.uy)));
+                    if (dev.lx - e >= clip.ux || dev.ux + e <= clip.lx || dev.ly - e >= clip.uy || dev.uy + e <= clip.ly)
+                        continue;
+                    if (level)
+                        writeVisibleRanges(level - 1, i * kTreeFanout, (i + 1) * kTreeFanout < levels[level - 1].size() ? (i + 1) * kTreeFanout : levels[level - 1].size(), ctm, scale, clip, li, ui, ranges);
+                    else if (ranges.end && ranges.back().end == lp)
+                        ranges.back().end = int(up);
+                    else
+                        new (ranges.alloc(1)) Range(lp, up);
+                }
+            }
+            AtomicCount::Type refCount;  size_t count = 0;  bool dirty = false;  std::vector<std::vector<Node>> levels;
+        };
+        //  A static scene's context output, recorded when one context draws the whole scene and replayed while the key matches.
+        //  Each list entry has its own, so a scene added twice is not drawn into one cache by two contexts.
+        struct Cache {
+            bool matches(Transform ctm, Bounds device, Bounds clip, size_t lz, size_t count, bool useCurves, float lodSize) const {
+                return valid && this->lz == lz && this->count == count && this->useCurves == useCurves && this->lodSize == lodSize
+                    && memcmp(& this->ctm, & ctm, sizeof(ctm)) == 0 && memcmp(& this->device, & device, sizeof(device)) == 0 && memcmp(& this->clip, & clip, sizeof(clip)) == 0;
+            }
+            AtomicCount::Type refCount;  bool isStatic = false, valid = false, useCurves = false;  float lodSize = 0.f;  size_t version = 0;
+            size_t hits = 0, misses = 0, lz = 0, count = 0, hz = 0, uz = 0, segbase = 0, sibase = 0, outlineInstances = 0, p16total = 0;  bool compact = false;
+            Transform ctm;  Bounds device, clip;
+            Row<Segment> segments;  Row<uint32_t> segmentsIndices, paths;  Row<Upload> uploads;  Row<Blend> blends;  Row<Instance> opaques;
+            Row<Colorant> colors;  Row<Transform> ctms, clips;  Row<float> widths;  Row<Bounds> bounds;
+        };
+        //  Versions come from one counter, so no two scenes share one, and a frame can be keyed by its scenes' versions
+        static size_t nextVersion() { static std::atomic<size_t> version(0);  return ++version; }
+        void setStatic(bool isStatic) {
+            cache->isStatic = isStatic, cache->valid = false, cache->version = nextVersion();
+        }
+        //  Call after writing ctms, colors, widths, flags or bnds in place, so the tree, cache and frame key are not stale.
+        void invalidate() {
+            tree->dirty = true, cache->valid = false, cache->version = nextVersion();
+        }
         enum Flags { kInvisible = 1 << 0, kFillEvenOdd = 1 << 1, kRoundCap = 1 << 2, kSquareCap = 1 << 3 };
+        //  Paths added after this store their points quantized where they hold to kQuantizedError pixels drawn at up to
+        //  maxZoom times ctm, the scene's scale to device space: the list's ctm concatenated with the scene's list ctm. The
+        //  error grows with any zoom past that, or a larger ctm. A maxZoom of 0 keeps float points.
+        void quantize(Transform ctm, float maxZoom) {
+            quantizeScale = maxZoom * sqrtf(fabsf(ctm.a * ctm.d - ctm.b * ctm.c));
+        }
+        //  A path's derived data is written by the first scene it is added to, and only read after that, so a path may be
+        //  added to scenes on several threads once one scene has it.
         void addPath(Path path, Transform ctm, Colorant color, float width, uint8_t flag, Bounds *clipBounds = nullptr) {
             if (path->isValid()) {
                 Geometry *g = path.ptr;
                 count++, weight += g->types.end;
-                if (kMoleculesHeight && g->p16s.end == 0)
-                    P16Writer().writeGeometry(g);
-                g->minUpper = g->minUpper ?: g->upperBound(kMinUpperDet);
+                if (g->block == nullptr) {
+                    if (kMoleculesHeight && g->p16s.end == 0)
+                        P16Writer().writeGeometry(g);
+                    g->minUpper = g->minUpper ?: g->upperBound(kMinUpperDet), g->area = g->area ?: g->signedArea(), g->evenOddArea = g->evenOddArea ?: g->counts[Geometry::kMove] > 1 ? g->nestedArea() : fabsf(g->area), g->hash(), g->freeze(arena, quantizeScale * sqrtf(fabsf(ctm.a * ctm.d - ctm.b * ctm.c)));
+                }
                 paths->add(path), *bnds.alloc(1) = g->bounds, ctms->add(ctm), colors->add(color), widths->add(width), flags->add(flag);
-                *clips.alloc(1) = clipBounds ? *clipBounds : Bounds::huge();
+                *clips.alloc(1) = clipBounds ? *clipBounds : Bounds::huge(), cache->version = nextVersion();
             }
         }
         Bounds bounds() const {
@@ -407,8 +699,9 @@ struct Rasterizer {
             return b;
         }
         size_t count = 0, weight = 0;
-        Ref<Vector<Path>> paths;  Row<Bounds> bnds, clips;
+        Ref<Vector<Path>> paths;  Row<Bounds, AtomicCount> bnds, clips;
         Ref<RowPair<Transform>> ctms;  Ref<RowPair<Colorant>> colors;  Ref<RowPair<float>> widths;  Ref<RowPair<uint8_t>> flags;
+        Ref<Tree> tree;  Ref<Cache> cache;  Ref<Arena> arena = Ref<Arena>(nullptr);  float quantizeScale = 0.f;
     };
     
     struct SceneList {
@@ -423,13 +716,40 @@ struct Rasterizer {
                 addScene(list.scenes[i], list.ctms[i], list.clips[i]);
             return *this;
         }
+        //  A scene's first entry uses the scene's cache, so it persists across lists. Later entries of the same scene, found
+        //  by a scan linear in the list's scenes, get their own.
         SceneList& addScene(Scene scene, Transform ctm = Transform(), Bounds clip = Bounds::huge()) {
-            if (scene.weight)
+            if (scene.weight) {
+                bool repeated = false;
+                for (auto& cache : caches)
+                    repeated |= cache.ptr == scene.cache.ptr;
                 pathsCount += scene.count, scenes.emplace_back(scene), ctms.emplace_back(ctm), clips.emplace_back(clip);
+                caches.emplace_back(repeated ? Ref<Scene::Cache>() : scene.cache);
+            }
             return *this;
         }
         Transform ctm;  bool useCurves = true;  Colorant clearColor = { 0xFF, 0xFF, 0xFF, 0xFF };
-        size_t pathsCount = 0;  std::vector<Scene> scenes;  std::vector<Transform> ctms;  std::vector<Bounds> clips;
+        size_t pathsCount = 0;  std::vector<Scene> scenes;  std::vector<Transform> ctms;  std::vector<Bounds> clips;  std::vector<Ref<Scene::Cache>> caches;
+    };
+    //  Passes scene lists built on one thread to another. Scenes share their paths and attributes by atomic counts, so
+    //  either side may release its copy, but a list must not be changed once posted. Only the newest list is kept.
+    struct SceneListHandoff {
+        void post(SceneList list) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = list, posted = true;
+        }
+        bool take(SceneList& list) {
+            SceneList taken;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!posted)
+                    return false;
+                std::swap(taken, pending), posted = false;
+            }
+            list = taken;
+            return true;
+        }
+        std::mutex mutex;  SceneList pending;  bool posted = false;
     };
     struct Segment {
         inline Segment(float x0, float y0, float x1, float y1, bool curve) : ix0((*((uint32_t *)& x0) & ~1) | curve), y0(y0), x1(x1), y1(y1) {}
@@ -454,49 +774,268 @@ struct Rasterizer {
         union { struct { int count, idx; } data;  Bounds clip; };
         Geometry *g;
     };
+    //  A molecule path whose points a context uploads once, however many instances it draws. Its molecule instances
+    //  hold the upload's index in quad.base until the upload's position in the points buffer replaces it. A fresh
+    //  point pool slot is copied to, whether or not the context then draws from the pool.
+    struct Upload {
+        Upload(Geometry *g, size_t iz) : g(g), iz(uint32_t(iz)) {}
+        Geometry *g;  uint32_t iz, base = 0, slot = 0;  bool fresh = false;
+    };
+    //  Molecule points kept between frames, so a path that stays visible is copied once. A slot holds its geometry, and
+    //  once unused for kPointPoolFrames frames, more than a layer keeps in flight, it may be freed to make room, or after
+    //  kTrimFrames in any case. The base never moves, so an upload that finds no room is copied into the frame's buffer.
+    struct PointPool {
+        //  A slot's generation changes whenever it is evicted or given to another geometry
+        struct Slot {
+            Ref<Geometry> g = Ref<Geometry>(nullptr);  uint32_t base, size, generation = 0;  size_t frame;
+        };
+        struct Use {
+            uint32_t slot, generation;
+        };
+        PointPool(size_t bytes) {
+            size = (bytes + kPageSize - 1) / kPageSize * kPageSize, posix_memalign((void **)& base, kPageSize, size);
+            addSpace(0, uint32_t(size / sizeof(Point16)));
+        }
+        ~PointPool() { free(base); }
+        
+        void beginFrame() {
+            uploaded = reused = copied = evicted = 0;
+            if (++frame % kTrimFrames == 0)
+                evict(kTrimFrames);
+        }
+        //  Finds or makes g's slot, returning its index, or -1 if there is no room
+        int alloc(Geometry *g, Upload& upload) {
+            auto it = index.find(g);  uint32_t n = uint32_t(g->p16s.end), at;  int i;
+            if (it != index.end()) {
+                Slot& slot = slots[it->second];
+                slot.frame = frame, upload.slot = slot.base, upload.fresh = false, reused += n * sizeof(Point16);
+                return it->second;
+            }
+            if (!fit(n, at) && !(evict(kPointPoolFrames) && fit(n, at)))
+                return -1;
+            if (unused.size())
+                i = unused.back(), unused.pop_back();
+            else
+                i = int(slots.size()), slots.emplace_back();
+            Slot& slot = slots[i];
+            slot.g = Ref<Geometry>(g), slot.base = at, slot.size = n, slot.frame = frame, slot.generation++, index.emplace(g, i);
+            upload.slot = at, upload.fresh = true, uploaded += n * sizeof(Point16);
+            return i;
+        }
+        //  A buffer may only be shown again if its slots still hold the points it was written with
+        bool holds(Row<Use>& used) const {
+            for (Use *u = used.base, *end = u + used.end; u < end; u++)
+                if (slots[u->slot].generation != u->generation)
+                    return false;
+            return true;
+        }
+        //  Keeps the slots of a buffer that is shown again
+        void touch(Row<Use>& used) {
+            for (Use *u = used.base, *end = u + used.end; u < end; u++)
+                slots[u->slot].frame = frame;
+        }
+        //  The best fit of the free spaces, which are kept by base for merging and by (size, base) for fitting, so both are
+        //  logarithmic in their count
+        bool fit(uint32_t n, uint32_t& at) {
+            if (n == 0)
+                return at = 0, true;
+            auto it = sizes.lower_bound(uint64_t(n) << 32);
+            if (it == sizes.end())
+                return false;
+            uint32_t space = uint32_t(it->first >> 32);
+            at = it->second, spaces.erase(at), sizes.erase(it);
+            if (space > n)
+                addSpace(at + n, space - n);
+            return true;
+        }
+        void addSpace(uint32_t at, uint32_t n) {
+            spaces.emplace(at, n), sizes.emplace(uint64_t(n) << 32 | at, at);
+        }
+        void removeSpace(std::map<uint32_t, uint32_t>::iterator it) {
+            sizes.erase(uint64_t(it->second) << 32 | it->first), spaces.erase(it);
+        }
+        //  Frees the slots unused for age frames, merging their space with its neighbours
+        bool evict(size_t age) {
+            size_t freed = 0;
+            for (uint32_t i = 0; i < slots.size(); i++) {
+                Slot& slot = slots[i];
+                if (slot.g.ptr == nullptr || slot.frame + age > frame)
+                    continue;
+                if (slot.size) {
+                    uint32_t at = slot.base, n = slot.size;
+                    auto next = spaces.lower_bound(at);
+                    if (next != spaces.end() && at + n == next->first)
+                        n += next->second, removeSpace(next);
+                    auto prev = spaces.lower_bound(at);
+                    if (prev != spaces.begin() && (--prev)->first + prev->second == at)
+                        at = prev->first, n += prev->second, removeSpace(prev);
+                    addSpace(at, n);
+                }
+                freed += slot.size * sizeof(Point16), index.erase(slot.g.ptr), slot.g = Ref<Geometry>(nullptr), slot.generation++, unused.emplace_back(i);
+            }
+            evicted += freed;
+            return freed != 0;
+        }
+        size_t refCount = 0, size = 0, frame = 0, uploaded = 0, reused = 0, copied = 0, evicted = 0;  Point16 *base = nullptr;
+        std::vector<Slot> slots;  std::vector<uint32_t> unused;  std::unordered_map<Geometry *, uint32_t> index;
+        std::map<uint32_t, uint32_t> spaces;  std::map<uint64_t, uint32_t> sizes;
+    };
     struct Edge {
         uint32_t ic;  enum Flags { ue0 = 0xF << 28, ue1 = 0xF << 24, kMask = ~(ue0 | ue1) };
         uint16_t i0, ux;
     };
+    //  The compact encoding of a buffer's records. Segments are written in runs, each led by its frame. A run is 16-bit
+    //  fixed point within its bounds, with the curve flag in x0's low bit as in the float form, and is at most 65534 *
+    //  kCompactSegmentError across, so no coordinate moves by more than kCompactSegmentError. Segments longer than that
+    //  are written in runs of floats.
+    struct Segment16 {
+        uint16_t x0, y0, x1, y1;
+    };
+    struct SegmentFrame {
+        enum { kFloats = 1u << 31 };
+        static inline Bounds bounds(const Segment& s) { return Bounds(fminf(s.x0, s.x1), fminf(s.y0, s.y1), fmaxf(s.x0, s.x1), fmaxf(s.y0, s.y1)); }
+        static inline bool fits(Bounds b) { return fmaxf(b.width(), b.height()) <= 65534.f * kCompactSegmentError; }
+        SegmentFrame(Bounds b, size_t count, bool floats) : ox(b.lx), oy(b.ly), count(uint32_t(count) | floats * kFloats) {
+            sx = b.ux > b.lx ? (b.ux - b.lx) / 65534.f : 1.f, sy = b.uy > b.ly ? (b.uy - b.ly) / 65534.f : 1.f;
+        }
+        inline uint16_t quantize(float v, float o, float s) const { return uint16_t(fminf(65534.f, fmaxf(0.f, roundf((v - o) / s)))); }
+        inline Segment16 encode(const Segment& s) const {
+            return { uint16_t(uint32_t(fminf(65534.f, fmaxf(0.f, 2.f * roundf(0.5f * (s.x0 - ox) / sx)))) | (s.ix0 & 1)), quantize(s.y0, oy, sy), quantize(s.x1, ox, sx), quantize(s.y1, oy, sy) };
+        }
+        inline Segment decode(const Segment16& s) const {
+            return Segment(ox + (s.x0 & ~1) * sx, oy + s.y0 * sy, ox + s.x1 * sx, oy + s.y1 * sy, s.x0 & 1);
+        }
+        float ox, oy, sx, sy;  uint32_t count;
+    };
+    //  Instances other than outlines leave out the outline fields. An instances entry is written as its quad and outline
+    //  counts, a bit per instance marking outlines if it has both kinds, its quads, then its outlines.
+    struct QuadInstance {
+        uint32_t iz;  Quad quad;
+    };
+    //  A cover of up to kMaxFatline * kCoverScale takes 18 bits, and a row of a 65535 px clip at kMinFatline the other 14,
+    //  so a sample stays 12 bytes.
     struct Sample {
-        Sample(float lx, float ux, float cover, size_t is): lx(lx), ux(ceilf(ux)), cover(int16_t(cover)), is(uint32_t(is)) {}
-        int16_t lx, ux, cover;  uint32_t is;
+        Sample(float lx, float ux, float cover, size_t is, float iy): lx(lx), ux(ceilf(ux)), cover(int32_t(cover)), iy(uint32_t(iy)), is(uint32_t(is)) {}
+        int16_t lx, ux;  int32_t cover : 18;  uint32_t iy : 14;  uint32_t is;
     };
     struct Buffer {
-        enum Type { kQuadEdges, kFastEdges, kFastMolecules, kQuadMolecules, kOpaques, kInstances, kSegmentsBase, kPointsBase, kInstancesBase };
+        enum Type { kQuadEdges, kFastEdges, kFastMolecules, kQuadMolecules, kOpaques, kInstances, kSegmentsBase, kPointsBase, kInstancesBase, kPointPoolBase };
         struct Entry {
             Entry(Type type, size_t begin, size_t end) : type(type), begin(begin), end(end) {}
             Type type;  size_t begin, end;
         };
-        ~Buffer() { if (base) free(base); }
+        //  The header rows one context writes for the visible paths of its range, with their list indices, in z order
+        struct Header {
+            size_t alloc(size_t n) {
+                paths.alloc(n), colors.alloc(n), ctms.alloc(n), clips.alloc(n), widths.alloc(n), bounds.alloc(n);
+                return paths.end - n;
+            }
+            void empty() { paths.empty(), colors.empty(), ctms.empty(), clips.empty(), widths.empty(), bounds.empty(); }
+            void reset() { paths.reset(), colors.reset(), ctms.reset(), clips.reset(), widths.reset(), bounds.reset(); }
+            void trim(const TrimPolicy& policy) {
+                paths.trim(policy), colors.trim(policy), ctms.trim(policy), clips.trim(policy), widths.trim(policy), bounds.trim(policy);
+            }
+            size_t bytes() const { return paths.bytes() + colors.bytes() + ctms.bytes() + clips.bytes() + widths.bytes() + bounds.bytes(); }
+            Row<uint32_t> paths;  Row<Colorant> colors;  Row<Transform> ctms, clips;  Row<float> widths;  Row<Bounds> bounds;
+        };
+        ~Buffer() {
+            if (mapped)
+                munmap(base, reserved);
+            else if (base)
+                free(base);
+        }
         
+        //  A compact buffer's header holds only the visible paths, so it is laid out and sized by resizeBuffer. The contexts'
+        //  segment windows come first, as they are written while drawing.
         void prepare(SceneList& list) {
-            pathsCount = list.pathsCount;
+            layout(compact ? 0 : list.pathsCount), entries.empty(), sceneBases.empty(), fingerprint = 0;
+            for (size_t i = 0, lz = 0; i < list.scenes.size(); lz += list.scenes[i].count, i++)
+                *sceneBases.alloc(1) = lz;
+            if (!compact || windows)
+                resize(headerSize);
+        }
+        void layout(size_t count) {
+            pathsCount = count;
             size_t i, sizes[] = { sizeof(Colorant), sizeof(Transform), sizeof(Transform), sizeof(float), sizeof(Bounds) };
-            size_t count = sizeof(sizes) / sizeof(*sizes), base = 0, bases[count];
-            for (i = 0; i < count; i++)
+            size_t n = sizeof(sizes) / sizeof(*sizes), base = windows, bases[n];
+            for (i = 0; i < n; i++)
                 bases[i] = base, base += pathsCount * sizes[i];
             colors = bases[0], ctms = bases[1], clips = bases[2], widths = bases[3], bounds = bases[4];
-            headerSize = (base + 15) & ~15, resize(headerSize), entries.empty();
+            headerSize = (base + 15) & ~15;
+        }
+        //  The list index of the path at header index iz, for hit testing and debugging a compact buffer
+        size_t listIndex(size_t iz) const { return compact ? paths.base[iz] : iz; }
+        //  The scene of the path at header index iz, and its index within that scene, found among the scenes' list bases
+        void pathIndex(size_t iz, size_t& si, size_t& is) const {
+            size_t li = listIndex(iz), lo = 0, hi = sceneBases.end, mid;
+            while (hi - lo > 1)
+                if (sceneBases.base[mid = (lo + hi) / 2] <= li)
+                    lo = mid;
+                else
+                    hi = mid;
+            si = lo, is = li - sceneBases.base[lo];
         }
+        //  A resize without a copy starts a frame, so the last frame's allocation is its use
         void resize(size_t n, size_t copySize = 0) {
-            if (copySize == 0 && allocation && size > 1000000 && size / allocation > 5)
-                allocation = size = 0, free(base), base = nullptr;
+            size_t target = 0;
+            if (copySize == 0 && allocation && trimPolicy.shrinks(mark, allocation, size)) {
+                target = (mark + mark / 2 + kPageSize - 1) / kPageSize * kPageSize;
+                if (mapped)
+                    decommit(target);
+                else
+                    size = 0, free(base), base = nullptr;
+            }
             allocation = (n + kPageSize - 1) / kPageSize * kPageSize;
+            if (size < allocation && (reservation || mapped) && commit(allocation > target ? allocation : target, copySize))
+                return;
             if (size < allocation) {
-                size = allocation;
+                size = allocation > target ? allocation : target;
                 uint8_t *resized;  posix_memalign((void **)& resized, kPageSize, size);
                 if (base) {
                     if (copySize)
                         memcpy(resized, base, copySize);
-                    free(base);
+                    if (mapped)
+                        munmap(base, reserved);
+                    else
+                        free(base);
                 }
-                base = resized;
+                base = resized, mapped = false, reserved = 0, moves++;
             }
         }
-        uint8_t *base = nullptr;  Row<Entry> entries;
-        bool useCurves = false;   Colorant clearColor = Colorant(255, 255, 255, 255);
-        size_t colors, ctms, clips, widths, bounds, idxs, pathsCount, headerSize, size = 0, allocation = 0;
+        //  A buffer with a reservation maps that much address space once and commits pages as it grows, so its base only
+        //  moves if a frame outgrows the whole range. Committed pages stay mapped between frames until a trim returns them.
+        //  If the range cannot be mapped or committed, the reservation is dropped and the buffer moves to the heap.
+        bool commit(size_t n, size_t copySize) {
+            if (!mapped || n > reserved) {
+                size_t length = (std::max(reservation, n + n / 2) + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+                uint8_t *mapping = (uint8_t *)mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+                if (mapping == MAP_FAILED)
+                    return reservation = 0, false;
+#ifdef MADV_HUGEPAGE
+                if (hugePages)
+                    madvise(mapping, length, MADV_HUGEPAGE);
+#endif
+                if (mprotect(mapping, n, PROT_READ | PROT_WRITE) != 0)
+                    return munmap(mapping, length), reservation = 0, false;
+                if (base && copySize)
+                    memcpy(mapping, base, copySize);
+                if (mapped)
+                    munmap(base, reserved);
+                else
+                    free(base);
+                base = mapping, reserved = length, mapped = true, moves++;
+            } else if (mprotect(base + size, n - size, PROT_READ | PROT_WRITE) != 0)
+                return reservation = 0, false;
+            return size = n, true;
+        }
+        //  Mapping fresh pages over the tail returns its memory on every platform. If that fails the pages stay committed.
+        void decommit(size_t n) {
+            if (n < size && mmap(base + n, size - n, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_FIXED | MAP_NORESERVE, -1, 0) != MAP_FAILED)
+                size = n;
+        }
+        uint8_t *base = nullptr;  Row<Entry> entries;  Row<uint32_t> paths;  Row<size_t> sceneBases;  Row<PointPool::Use> poolSlots;  Ref<PointPool> pool = Ref<PointPool>(nullptr);
+        bool useCurves = false, compact = false, hugePages = false, mapped = false, adaptiveFatlines = false;   Colorant clearColor = Colorant(255, 255, 255, 255);  TrimPolicy trimPolicy;
+        size_t colors, ctms, clips, widths, bounds, idxs, pathsCount, headerSize, windows = 0, size = 0, allocation = 0, mark = 0, reservation = 0, reserved = 0, moves = 0;  uint64_t fingerprint = 0;
     };
     struct Allocator {
         enum CountType { kFastEdges, kQuadEdges, kFastMolecules, kQuadMolecules };
@@ -505,15 +1044,16 @@ struct Rasterizer {
             size_t count() const { return counts[0] + counts[1] + counts[2] + counts[3]; }
             size_t idx, counts[4] = { 0, 0, 0, 0 };
         };
-        void empty(Bounds device) {
-            full = device, sheet = Bounds(0.f, 0.f, 0.f, 0.f), bzero(strips, sizeof(strips)), passes.empty(), new (passes.alloc(1)) Pass(0);
+        //  Adaptive fat lines may be kMinFatline high, so they get strips from a lower base height
+        void empty(Bounds device, float base = kStripHeight) {
+            full = device, stripHeight = base, sheet = Bounds(0.f, 0.f, 0.f, 0.f), bzero(strips, sizeof(strips)), passes.empty(), new (passes.alloc(1)) Pass(0);
         }
         void refill(size_t idx) {
             sheet = full, bzero(strips, sizeof(strips)), new (passes.alloc(1)) Pass(idx);
         }
         inline void alloc(float lx, float ly, float ux, float uy, size_t idx, Cell *cell, int type, size_t count) {
             float w = ux - lx, h = uy - ly;
-            size_t i = fmaxf(0.f, ceilf(log2f(h / kStripHeight))), hght = (1 << i) * kStripHeight;
+            size_t i = fmaxf(0.f, ceilf(log2f(h / stripHeight))), hght = (1 << i) * stripHeight;
             Bounds *strip = strips + i;
             if (strip->ux - strip->lx < w) {
                 if (sheet.uy - sheet.ly < hght)
@@ -523,33 +1063,129 @@ struct Rasterizer {
             cell->ox = strip->lx, cell->oy = strip->ly, cell->lx = lx, cell->ly = ly, cell->ux = ux, cell->uy = uy, strip->lx += w;
             passes.back().counts[type] += count;
         }
-        Row<Pass> passes;
+        Row<Pass> passes;  float stripHeight = kStripHeight;
         Bounds full, sheet, strips[kStripCount];
     };
     
+    struct CostModel {
+        enum Feature { kPaths, kPoints, kOutlines, kMolecules, kSegments, kFatlines, kFeatureCount };
+        inline float cost(const float *features) const {
+            float c = 0.f;
+            for (int i = 0; i < kFeatureCount; i++)
+                c += weights[i] * features[i];
+            return c;
+        }
+        void calibrate(const float *features, float actual) {
+            float predicted = cost(features), ratio;
+            if (predicted > 0.f && actual > 0.f) {
+                ratio = fmaxf(0.5f, fminf(2.f, actual / predicted)) - 1.f;
+                for (int i = 0; i < kFeatureCount; i++)
+                    weights[i] *= 1.f + kRate * ratio * weights[i] * features[i] / predicted;
+            }
+        }
+        constexpr static float kRate = 0.25f;
+        float weights[kFeatureCount] = { 20.f, 4.f, 10.f, 1.f, 12.f, 40.f };
+    };
+    static void writeVisibleRanges(Scene *scn, Transform ctm, Bounds device, Bounds sceneclip, size_t li, size_t ui, Row<Range>& ranges) {
+        ranges.empty();
+        Scene::Tree *tree = scn->tree.ptr;
+        if (tree->dirty || tree->count != scn->count || tree->levels.size() == 0)
+            new (ranges.alloc(1)) Range(li, ui);
+        else {
+            Bounds clip = sceneclip.isHuge() ? device : device.intersect(Bounds(sceneclip.quad(ctm)));
+            tree->writeVisibleRanges(tree->levels.size() - 1, 0, tree->levels.back().size(), ctm, sqrtf(fabsf(ctm.a * ctm.d - ctm.b * ctm.c)), clip, li, ui, ranges);
+        }
+    }
+    static void writeCostFeatures(SceneList& list, Bounds device, Transform view, size_t slz, size_t suz, float lodSize, bool adaptiveFatlines, float *features) {
+        size_t lz, uz, i, clz, cuz, is, ir, upper;  float det, width, uw;  Geometry *g;  Row<Range> ranges;
+        for (lz = uz = i = 0; i < list.scenes.size() && lz < suz; i++, lz = uz) {
+            Scene *scn = & list.scenes[i];
+            uz = lz + scn->count, clz = lz < slz ? slz : lz > suz ? suz : lz, cuz = uz < slz ? slz : uz > suz ? suz : uz;
+            Transform ctm = view.concat(list.ctms[i]), m;
+            Bounds dev, clip, clipBounds, sceneclip = list.clips[i], lastClip;
+            if (scn->cache->isStatic && list.caches[i]->version == scn->cache->version && list.caches[i]->matches(ctm, device, sceneclip, lz, scn->count, list.useCurves, lodSize)) {
+                features[CostModel::kPaths] += cuz - clz;
+                continue;
+            }
+            if (clz < cuz)
+                writeVisibleRanges(scn, ctm, device, sceneclip, clz - lz, cuz - lz, ranges);
+            for (ir = 0; clz < cuz && ir < ranges.end; ir++)
+            for (is = ranges.base[ir].begin < clz - lz ? clz - lz : ranges.base[ir].begin; is < ranges.base[ir].end && is < cuz - lz; is++) {
+                features[CostModel::kPaths]++;
+                if (scn->flags->base[is] & Scene::Flags::kInvisible)
+                    continue;
+                m = ctm.concat(scn->ctms->base[is]), det = fabsf(m.a * m.d - m.b * m.c);
+                uw = scn->widths->base[is], width = uw * (uw > 0.f ? sqrtf(det) : -1.f);
+                if (memcmp(scn->clips.base + is, & lastClip, sizeof(Bounds)) != 0) {
+                    lastClip = scn->clips.base[is];
+                    clipBounds = !lastClip.isHuge() || !sceneclip.isHuge() ? Bounds(sceneclip.intersect(lastClip).quad(ctm)).integral().intersect(device) : device;
+                }
+                dev = Bounds(scn->bnds.base[is].quad(m)).inset(-width, -width), clip = dev.integral().intersect(clipBounds);
+                if (clip.lx < clip.ux && clip.ly < clip.uy) {
+                    g = scn->paths->base[is].ptr, upper = det < kMinUpperDet ? g->minUpper : g->upperBound(det);
+                    if (width)
+                        features[CostModel::kPoints] += g->types.end * (det > 1e2f ? 2.f : 1.f), features[CostModel::kOutlines] += upper;
+                    else if (clip.uy - clip.ly <= kMoleculesHeight && clip.ux - clip.lx <= kMoleculesHeight)
+                        features[CostModel::kMolecules] += dev.ux - dev.lx < lodSize && dev.uy - dev.ly < lodSize ? 0 : g->p16s.end;
+                    else
+                        features[CostModel::kPoints] += g->types.end, features[CostModel::kFatlines] += (clip.uy - clip.ly) / (adaptiveFatlines ? fatlineHeight(g, m) : kfh),
+                        features[CostModel::kSegments] += upper * fminf(1.f, clip.width() * clip.height() / fmaxf(1.f, dev.width() * dev.height()));
+                }
+            }
+        }
+    }
+    
     struct Context {
+        //  A path drawn unclipped last frame and moved by a whole pixel pan (dx, dy) has its output copied and shifted
+        //  from the previous frame's rows. Paths entering or leaving the device, or changed in any other way, are redrawn.
+        //  Spans are only written for drawn paths, in increasing iz, so last frame's are found by a cursor moving with iz.
+        struct Span {
+            inline bool rebases(const Span& next, int dx, int dy) const {
+                float ex = 1e-2f + 1e-6f * fabsf(next.m.tx), ey = 1e-2f + 1e-6f * fabsf(next.m.ty);
+                return g == next.g && unclipped && next.unclipped && flags == next.flags && width == next.width && color == next.color
+                    && m.a == next.m.a && m.b == next.m.b && m.c == next.m.c && m.d == next.m.d
+                    && fabsf(m.tx + dx - next.m.tx) < ex && fabsf(m.ty + dy - next.m.ty) < ey
+                    && clip.lx + dx == next.clip.lx && clip.ly + dy == next.clip.ly && clip.ux + dx == next.clip.ux && clip.uy + dy == next.clip.uy;
+            }
+            Geometry *g;  Transform m;  Bounds clip;  size_t iz;  uint32_t color, hz;  float width;  uint8_t flags;  bool unclipped, molecule;  int upload;
+            Range blends, opaques, segments, indices;  size_t outlines, p16s;
+        };
         void drawList(SceneList& list, Bounds device, Transform view, size_t slz, size_t suz, Buffer *buffer) {
-            empty(), allocator.empty(device);
-            size_t fatlines = 1.f + ceilf((device.uy - device.ly) * krfh);
-            if (samples.size() != fatlines)
-                samples.resize(fatlines);
-            fasts.zalloc(list.pathsCount);
+            if (retainSpans)
+                std::swap(spans, prevSpans), std::swap(blends, prevBlends), std::swap(opaques, prevOpaques), std::swap(segments, prevSegments), std::swap(segmentsIndices, prevSegmentsIndices);
+            spans.empty(), empty(), allocator.empty(device, buffer->adaptiveFatlines ? kAdaptiveStripHeight : kStripHeight), segmentsPeak = 0;
+            if (windowSize)
+                segments.borrow((Segment *)(buffer->base + window), windowSize);
+            else if (segmentsInWindow())
+                segments.reclaim();
+            bool rebase = retainSpans && pan;
+            Span *span, *prev = prevSpans.base, *prevEnd = prevSpans.base + prevSpans.end;
             
             Colorant *colors = (Colorant *)(buffer->base + buffer->colors);
             Transform *ctms = (Transform *)(buffer->base + buffer->ctms);
             Transform *clips = (Transform *)(buffer->base + buffer->clips);
             float *widths = (float *)(buffer->base + buffer->widths);
             Bounds *bounds = (Bounds *)(buffer->base + buffer->bounds);
-            bool clipActive = false;
+            bool clipActive = false, compact = buffer->compact;
             
-            size_t lz, uz, i, clz, cuz, iz, is, size, cnt;  uint8_t flags;
+            size_t lz, uz, i, clz, cuz, iz, hz, is, ir, size, cnt;  uint8_t flags;
             float det, width, uw, softclipMargin = 0.5f;
             for (lz = uz = i = 0; i < list.scenes.size(); i++, lz = uz) {
                 Scene *scn = & list.scenes[i];
                 uz = lz + scn->count, clz = lz < slz ? slz : lz > suz ? suz : lz, cuz = uz < slz ? slz : uz > suz ? suz : uz;
                 Transform ctm = view.concat(list.ctms[i]), clipquad, m, quad, invclip;
                 Bounds dev, clip, *bnds, clipBounds, sceneclip = list.clips[i], lastClip;
-                for (is = clz - lz, iz = clz; iz < cuz; iz++, is++) {
+                Scene::Cache *entryCache = list.caches[i].ptr;
+                bool cached = scn->cache->isStatic && clz == lz && cuz == uz && lz < uz;
+                if (cached && entryCache->version == scn->cache->version && entryCache->compact == compact && entryCache->matches(ctm, device, sceneclip, lz, scn->count, buffer->useCurves, lodSize)) {
+                    readCache(*entryCache, buffer), entryCache->hits++;
+                    continue;
+                }
+                size_t hbase = compact ? header.paths.end : lz, ubase = uploads.end, segbase = segments.end, sibase = segmentsIndices.end, blendbase = blends.end, opaquebase = opaques.end, outlinebase = outlineInstances, p16base = p16total;
+                if (clz < cuz)
+                    writeVisibleRanges(scn, ctm, device, sceneclip, clz - lz, cuz - lz, ranges);
+                for (ir = 0; clz < cuz && ir < ranges.end; ir++)
+                for (is = ranges.base[ir].begin < clz - lz ? clz - lz : ranges.base[ir].begin, iz = lz + is; is < ranges.base[ir].end && iz < cuz; iz++, is++) {
                     if ((flags = scn->flags->base[is]) & Scene::Flags::kInvisible)
                         continue;
                     m = ctm.concat(scn->ctms->base[is]), det = fabsf(m.a * m.d - m.b * m.c);
@@ -567,12 +1203,28 @@ struct Rasterizer {
                     bnds = & scn->bnds.base[is], quad = bnds->quad(m), dev = Bounds(quad).inset(-width, -width);
                     clip = dev.integral().intersect(clipBounds);
                     if (clip.lx < clip.ux && clip.ly < clip.uy) {
-                        colors[iz] = scn->colors->base[is];
-                        ctms[iz] = m, widths[iz] = width, clips[iz] = invclip;
+                        if (compact)
+                            hz = header.alloc(1), header.paths.base[hz] = uint32_t(iz),
+                            colors = header.colors.base, ctms = header.ctms.base, clips = header.clips.base, widths = header.widths.base, bounds = header.bounds.base;
+                        else
+                            hz = iz;
+                        colors[hz] = scn->colors->base[is];
+                        ctms[hz] = m, widths[hz] = width, clips[hz] = invclip;
                         Geometry *g = scn->paths->base[is].ptr;
                         bool useMolecules = clip.uy - clip.ly <= kMoleculesHeight && clip.ux - clip.lx <= kMoleculesHeight;
-                        if (width) {
-                            Blend *inst = new (blends.alloc(1)) Blend(iz | Instance::kOutlines | bool(flags & Scene::kRoundCap) * Instance::kRoundCap | bool(flags & Scene::kSquareCap) * Instance::kSquareCap);
+                        if ((span = retainSpans ? spans.alloc(1) : nullptr)) {
+                            span->iz = iz, span->g = g, span->m = m, span->clip = clip, span->color = *(uint32_t *)(colors + hz), span->hz = uint32_t(hz), span->width = width, span->flags = flags;
+                            span->unclipped = clip.contains(dev), span->molecule = false, span->outlines = outlineInstances, span->p16s = p16total;
+                            span->blends.begin = int(blends.end), span->opaques.begin = int(opaques.end), span->segments.begin = int(segments.end), span->indices.begin = int(segmentsIndices.end);
+                        }
+                        for (; rebase && prev < prevEnd && prev->iz < iz; prev++)
+                            ;
+                        if (rebase && prev < prevEnd && prev->iz == iz && prev->rebases(*span, dx, dy)) {
+                            if (prev->molecule)
+                                bounds[hz] = *bnds, new (uploads.alloc(1)) Upload(g, iz);
+                            writeRebasedSpan(*prev, int(hz) - int(prev->hz), int(uploads.end) - 1 - prev->upload);
+                        } else if (width) {
+                            Blend *inst = new (blends.alloc(1)) Blend(hz | Instance::kOutlines | bool(flags & Scene::kRoundCap) * Instance::kRoundCap | bool(flags & Scene::kSquareCap) * Instance::kSquareCap);
                             inst->g = g, inst->clip = clip.contains(dev) ? Bounds::huge() : clip.inset(-width, -width);
                             if (det > 1e2f) {
                                 SegmentCounter counter;
@@ -580,20 +1232,30 @@ struct Rasterizer {
                                 outlineInstances += counter.count;
                             } else
                                 outlineInstances += (det < kMinUpperDet ? g->minUpper : g->upperBound(det));
+                        } else if (dev.ux - dev.lx < lodSize && dev.uy - dev.ly < lodSize) {
+                            Blend *inst = new (blends.alloc(1)) Blend(hz);
+                            Cell *cell = & inst->quad.cell;
+                            //  A solid cell, ox == kNullIndex, samples no accumulation, so oy carries its alpha in units of 1 / kNullIndex
+                            float area = flags & Scene::kFillEvenOdd ? g->evenOddArea : fabsf(g->area);
+                            inst->g = g, cell->lx = clip.lx, cell->ly = clip.ly, cell->ux = clip.ux, cell->uy = clip.uy, cell->ox = kNullIndex;
+                            cell->oy = kNullIndex * fminf(1.f, area * det / (clip.width() * clip.height()));
                         } else if (useMolecules) {
-                            bounds[iz] = *bnds, fasts.base[iz]++;
+                            bounds[hz] = *bnds, size = g->p16s.end;
+                            if (uploads.end == 0 || uploads.back().iz != iz)
+                                new (uploads.alloc(1)) Upload(g, iz), p16total += size;
                             bool fast = !buffer->useCurves || g->maxCurve * det < 16.f;
-                            Blend *inst = new (blends.alloc(1)) Blend(iz | Instance::kMolecule | bool(flags & Scene::kFillEvenOdd) * Instance::kEvenOdd | fast * Instance::kFastEdges);
-                            inst->g = g, inst->quad.cover = 0;
+                            Blend *inst = new (blends.alloc(1)) Blend(hz | Instance::kMolecule | bool(flags & Scene::kFillEvenOdd) * Instance::kEvenOdd | fast * Instance::kFastEdges);
+                            inst->g = g, inst->quad.cover = 0, inst->quad.base = int(uploads.end - 1);
                             int type = fast ? Allocator::kFastMolecules : Allocator::kQuadMolecules;
-                            size = g->p16s.end, p16total += size;
                             cnt = fast ? size / kFastSegments : g->atoms.end;
                             allocator.alloc(clip.lx, clip.ly, clip.ux, clip.uy, blends.end - 1, & inst->quad.cell, type, cnt);
                         } else {
                             bool fast = !buffer->useCurves || g->maxCurve * det < 4.f;
+                            size_t upper = det < kMinUpperDet ? g->minUpper : g->upperBound(det);
+                            float fh = buffer->adaptiveFatlines ? fatlineHeight(g, m) : kfh;
                             CurveIndexer idxr;
-                            idxr.clip = clip, idxr.samples = & samples[0], idxr.fast = fast;
-                            idxr.dst = idxr.dst0 = segments.alloc(2 * (det < kMinUpperDet ? g->minUpper : g->upperBound(det)));
+                            idxr.clip = clip, idxr.samples = & samples, idxr.fast = fast, idxr.setHeight(fh);
+                            idxr.dst = idxr.dst0 = segments.alloc(2 * upper), segmentsPeak = std::max(segmentsPeak, segments.end);
                             bool unclipped = clip.contains(dev);
                             divideGeometry(g, m, clip, unclipped, true, idxr);
                             bool softunclipped = true;
@@ -601,45 +1263,183 @@ struct Rasterizer {
                                 Bounds soft = Bounds(invclip.concat(quad));
                                 softunclipped = fmaxf(fmaxf(fabsf(soft.lx), fabsf(soft.ux)), fmaxf(fabsf(soft.ly), fabsf(soft.uy))) < softclipMargin;
                             }
-                            bool opaque = colors[iz].a == 255 && softunclipped;
-                            writeSegmentInstances(clip, flags & Scene::kFillEvenOdd, iz, opaque, fast, *this);
+                            bool opaque = colors[hz].a == 255 && softunclipped;
+                            if (apply && clip.uy - clip.ly > 2 * kBandFatlines * fh && idxr.dst - idxr.dst0 >= kMinBandSegments)
+                                writeBandedSegmentInstances(clip, fh, flags & Scene::kFillEvenOdd, hz, opaque, fast, *this);
+                            else
+                                writeSegmentInstances(clip, fh, flags & Scene::kFillEvenOdd, hz, opaque, fast, *this);
                             segments.idx = segments.end = idxr.dst - segments.base;
                         }
+                        if (span) {
+                            span->molecule = uploads.end && uploads.back().iz == iz, span->upload = int(uploads.end) - 1, span->outlines = outlineInstances - span->outlines, span->p16s = p16total - span->p16s;
+                            span->blends.end = int(blends.end), span->opaques.end = int(opaques.end), span->segments.end = int(segments.end), span->indices.end = int(segmentsIndices.end);
+                        }
                     }
                 }
+                if (cached) {
+                    Scene::Cache& cache = *entryCache;  size_t hend = compact ? header.paths.end : uz;
+                    cache.valid = true, cache.version = scn->cache->version, cache.misses++, cache.ctm = ctm, cache.device = device, cache.clip = sceneclip, cache.lz = lz, cache.count = scn->count;
+                    cache.compact = compact, cache.hz = hbase, cache.uz = ubase, cache.paths.empty();
+                    if (compact)
+                        copyRow(header.paths.base + hbase, hend - hbase, cache.paths);
+                    cache.useCurves = buffer->useCurves, cache.lodSize = lodSize, cache.segbase = segbase, cache.sibase = sibase;
+                    cache.outlineInstances = outlineInstances - outlinebase, cache.p16total = p16total - p16base;
+                    copyRow(segments.base + segbase, segments.end - segbase, cache.segments.empty());
+                    copyRow(segmentsIndices.base + sibase, segmentsIndices.end - sibase, cache.segmentsIndices.empty());
+                    copyRow(blends.base + blendbase, blends.end - blendbase, cache.blends.empty());
+                    copyRow(opaques.base + opaquebase, opaques.end - opaquebase, cache.opaques.empty());
+                    copyRow(uploads.base + ubase, uploads.end - ubase, cache.uploads.empty()), copyRow(colors + hbase, hend - hbase, cache.colors.empty());
+                    copyRow(ctms + hbase, hend - hbase, cache.ctms.empty()), copyRow(clips + hbase, hend - hbase, cache.clips.empty());
+                    copyRow(widths + hbase, hend - hbase, cache.widths.empty()), copyRow(bounds + hbase, hend - hbase, cache.bounds.empty());
+                }
+            }
+            segmentsPeak = std::max(segmentsPeak, segments.end);
+        }
+        template<typename T>
+        static inline void copyRow(T *src, size_t count, Row<T>& dst) {
+            if (count)
+                memcpy(dst.alloc(count), src, count * sizeof(T));
+        }
+        //  A compact header's cached rows are appended to this context's, and the cached instances moved to their indices.
+        void readCache(Scene::Cache& cache, Buffer *buffer) {
+            size_t lz = cache.lz, count = cache.colors.end, segdelta = segments.end - cache.segbase, sidelta = segmentsIndices.end - cache.sibase, blendbase = blends.end, opaquebase = opaques.end;
+            size_t hz = buffer->compact ? header.alloc(count) : lz;  int dz = int(hz) - int(cache.hz), du = int(uploads.end) - int(cache.uz);
+            copyRow(cache.segments.base, cache.segments.end, segments), segments.idx = segments.end;
+            copyRow(cache.segmentsIndices.base, cache.segmentsIndices.end, segmentsIndices);
+            copyRow(cache.blends.base, cache.blends.end, blends), copyRow(cache.opaques.base, cache.opaques.end, opaques);
+            copyRow(cache.uploads.base, cache.uploads.end, uploads);
+            if (buffer->compact) {
+                memcpy(header.paths.base + hz, cache.paths.base, count * sizeof(uint32_t));
+                memcpy(header.colors.base + hz, cache.colors.base, count * sizeof(Colorant));
+                memcpy(header.ctms.base + hz, cache.ctms.base, count * sizeof(Transform));
+                memcpy(header.clips.base + hz, cache.clips.base, count * sizeof(Transform));
+                memcpy(header.widths.base + hz, cache.widths.base, count * sizeof(float));
+                memcpy(header.bounds.base + hz, cache.bounds.base, count * sizeof(Bounds));
+                for (Instance *inst = opaques.base + opaquebase, *end = opaques.base + opaques.end; inst < end; inst++)
+                    inst->iz += dz;
+            } else {
+                memcpy((Colorant *)(buffer->base + buffer->colors) + lz, cache.colors.base, count * sizeof(Colorant));
+                memcpy((Transform *)(buffer->base + buffer->ctms) + lz, cache.ctms.base, count * sizeof(Transform));
+                memcpy((Transform *)(buffer->base + buffer->clips) + lz, cache.clips.base, count * sizeof(Transform));
+                memcpy((float *)(buffer->base + buffer->widths) + lz, cache.widths.base, count * sizeof(float));
+                memcpy((Bounds *)(buffer->base + buffer->bounds) + lz, cache.bounds.base, count * sizeof(Bounds));
+            }
+            outlineInstances += cache.outlineInstances, p16total += cache.p16total;
+            rebaseBlends(blendbase, int(segdelta), int(sidelta), 0, 0, dz, du);
+        }
+        void writeRebasedSpan(const Span& span, int dz, int du) {
+            size_t segdelta = segments.end - span.segments.begin, sidelta = segmentsIndices.end - span.indices.begin, blendbase = blends.end, count;
+            Segment *src = prevSegments.base + span.segments.begin, *dst = segments.alloc(count = span.segments.end - span.segments.begin), *end = src + count;
+            for (; src < end; src++, dst++)
+                new (dst) Segment(src->x0 + dx, src->y0 + dy, src->x1 + dx, src->y1 + dy, src->ix0 & 1);
+            segments.idx = segments.end;
+            copyRow(prevSegmentsIndices.base + span.indices.begin, span.indices.end - span.indices.begin, segmentsIndices);
+            Instance *inst = opaques.alloc(count = span.opaques.end - span.opaques.begin), *endinst = inst + count;
+            for (memcpy(inst, prevOpaques.base + span.opaques.begin, count * sizeof(Instance)); inst < endinst; inst++)
+                inst->iz += dz, inst->quad.cell.lx += dx, inst->quad.cell.ly += dy, inst->quad.cell.ux += dx, inst->quad.cell.uy += dy;
+            copyRow(prevBlends.base + span.blends.begin, span.blends.end - span.blends.begin, blends);
+            outlineInstances += span.outlines, p16total += span.p16s;
+            rebaseBlends(blendbase, int(segdelta), int(sidelta), dx, dy, dz, du);
+        }
+        //  Blends copied from an earlier frame point at new segment, index, header and upload bases, move by (dx, dy), and need
+        //  new atlas cells.
+        void rebaseBlends(size_t begin, int segdelta, int sidelta, int dx, int dy, int dz, int du) {
+            for (Blend *inst = blends.base + begin, *end = blends.base + blends.end; inst < end; inst++) {
+                Cell *cell = & inst->quad.cell;  bool fast = (inst->iz += dz) & Instance::kFastEdges;
+                if (inst->iz & Instance::kOutlines) {
+                    if (!inst->clip.isHuge())
+                        inst->clip.lx += dx, inst->clip.ly += dy, inst->clip.ux += dx, inst->clip.uy += dy;
+                    continue;
+                }
+                cell->lx += dx, cell->ly += dy, cell->ux += dx, cell->uy += dy;
+                if (inst->iz & Instance::kEdge) {
+                    inst->quad.base += segdelta, inst->data.idx += sidelta;
+                    allocator.alloc(cell->lx, cell->ly, cell->ux, cell->uy, inst - blends.base, cell, fast ? Allocator::kFastEdges : Allocator::kQuadEdges, (inst->data.count + 1) / 2);
+                } else if (inst->iz & Instance::kMolecule)
+                    inst->quad.base += du, allocator.alloc(cell->lx, cell->ly, cell->ux, cell->uy, inst - blends.base, cell, fast ? Allocator::kFastMolecules : Allocator::kQuadMolecules, fast ? inst->g->p16s.end / kFastSegments : inst->g->atoms.end);
             }
         }
         void empty() {
-            outlinePaths = outlineInstances = p16total = 0, blends.empty(), fasts.empty(), opaques.empty(), segments.empty(), segmentsIndices.empty(), indices.empty();
-            for (int i = 0; i < samples.size(); i++)
-                samples[i].empty();
+            trim(), outlinePaths = outlineInstances = p16total = 0, header.empty(), blends.empty(), uploads.empty(), opaques.empty(), segments.empty(), segmentsIndices.empty(), indices.empty(), samples.empty();
             entries = std::vector<Buffer::Entry>();
         }
-        void reset() { outlinePaths = outlineInstances = p16total = 0, blends.reset(), fasts.reset(), opaques.reset(), segments.reset(), segmentsIndices.reset(), indices.reset(), samples.resize(0), entries = std::vector<Buffer::Entry>(); }
-        size_t outlinePaths = 0, outlineInstances = 0, p16total;
-        Allocator allocator;  std::vector<Buffer::Entry> entries;
-        Row<uint32_t> fasts;  Row<Blend> blends;  Row<Instance> opaques;  Row<Segment> segments;
-        Row<Index> indices;  std::vector<Row<Sample>> samples;  Row<uint32_t> segmentsIndices;
+        void reset() {
+            outlinePaths = outlineInstances = p16total = 0, header.reset(), blends.reset(), uploads.reset(), opaques.reset(), segments.reset(), segmentsIndices.reset(), indices.reset(), samples.reset(), binned.reset(), rowOffsets.reset(), bands.resize(0), entries = std::vector<Buffer::Entry>();
+            spans.reset(), prevSpans.reset(), prevBlends.reset(), prevOpaques.reset(), prevSegments.reset(), prevSegmentsIndices.reset();
+        }
+        //  Shrinks scratch rows a spike, e.g. a deep zoom, has left far larger than recent frames need
+        void trim() {
+            header.trim(trimPolicy), blends.trim(trimPolicy), uploads.trim(trimPolicy), opaques.trim(trimPolicy), segments.trim(trimPolicy), segmentsIndices.trim(trimPolicy), indices.trim(trimPolicy), scratch.trim(trimPolicy), ranges.trim(trimPolicy);
+            spans.trim(trimPolicy), prevSpans.trim(trimPolicy), prevBlends.trim(trimPolicy), prevOpaques.trim(trimPolicy), prevSegments.trim(trimPolicy), prevSegmentsIndices.trim(trimPolicy);
+            samples.trim(trimPolicy), binned.trim(trimPolicy), rowOffsets.trim(trimPolicy);
+            for (auto& band : bands)
+                band.blends.trim(trimPolicy), band.opaques.trim(trimPolicy), band.segmentsIndices.trim(trimPolicy), band.indices.trim(trimPolicy), band.scratch.trim(trimPolicy);
+        }
+        //  Segments that have not outgrown their window are already in the buffer
+        bool segmentsInWindow() const { return segments.memory.ptr && segments.memory->borrowed; }
+        size_t residentBytes() const {
+            size_t bytes = header.bytes() + blends.bytes() + uploads.bytes() + opaques.bytes() + segments.bytes() + segmentsIndices.bytes() + indices.bytes() + scratch.bytes() + ranges.bytes() + allocator.passes.bytes()
+                + spans.bytes() + prevSpans.bytes() + prevBlends.bytes() + prevOpaques.bytes() + prevSegments.bytes() + prevSegmentsIndices.bytes() + entries.capacity() * sizeof(Buffer::Entry) + samples.bytes() + binned.bytes() + rowOffsets.bytes();
+            for (auto& band : bands)
+                bytes += band.blends.bytes() + band.opaques.bytes() + band.segmentsIndices.bytes() + band.indices.bytes() + band.scratch.bytes();
+            return bytes;
+        }
+        struct Band {
+            Row<Blend> blends;  Row<Instance> opaques;  Row<uint32_t> segmentsIndices, indices, scratch;
+        };
+        typedef void (*Function)(size_t i, void *info);
+        typedef void (*Apply)(void *jobs, size_t count, Function function, void *info);
+        size_t outlinePaths = 0, outlineInstances = 0, p16total = 0, headerBase = 0, window = 0, windowSize = 0, segmentsPeak = 0;
+        Apply apply = nullptr;  void *jobs = nullptr;  std::vector<Band> bands;  float lodSize = 0.f;
+        bool retainSpans = false, pan = false, pooled = false;  int dx = 0, dy = 0;  TrimPolicy trimPolicy;
+        Row<Span> spans, prevSpans;  Row<Blend> prevBlends;  Row<Instance> prevOpaques;  Row<Segment> prevSegments;  Row<uint32_t> prevSegmentsIndices;
+        Allocator allocator;  std::vector<Buffer::Entry> entries;  Buffer::Header header;
+        Row<Upload> uploads;  Row<Blend> blends;  Row<Instance> opaques;  Row<Segment> segments;
+        Row<Sample> samples;  Row<uint32_t> indices, scratch, segmentsIndices, binned, rowOffsets;  Row<Range> ranges;
     };
+    //  Subpaths whose molecule bounds lie outside the clip are skipped: strokes would write nothing, and a closed fill
+    //  subpath only writes clip edge segments that cancel. Subpaths inside the clip are written unclipped.
     static void divideGeometry(Geometry *g, Transform m, Bounds clip, bool unclipped, bool polygon, GeometryWriter& writer) {
-        bool closed, closeSubpath = false;  float *p = g->points.base, sx = FLT_MAX, sy = FLT_MAX, x0 = FLT_MAX, y0 = FLT_MAX, x1, y1, x2, y2, x3, y3, ly, uy, lx, ux;
-        for (uint8_t *type = g->types.base, *end = type + g->types.end; type < end; )
+        if (g->quantized)
+            divideGeometry(g, m, clip, unclipped, polygon, writer, g->quantized);
+        else
+            divideGeometry(g, m, clip, unclipped, polygon, writer, g->points.base);
+    }
+    //  Quantized points are decoded by concatenating each subpath's molecule bounds onto the transform.
+    template<typename P>
+    static void divideGeometry(Geometry *g, Transform m, Bounds clip, bool unclipped, bool polygon, GeometryWriter& writer, P *p) {
+        bool closed, closeSubpath = false;  Transform mp = m;  Bounds *qb = g->molecules.base;  float sx = FLT_MAX, sy = FLT_MAX, x0 = FLT_MAX, y0 = FLT_MAX, x1, y1, x2, y2, x3, y3, ly, uy, lx, ux, e;
+        Bounds *molecule = !unclipped && g->molecules.end == g->counts[Geometry::kMove] ? g->molecules.base : nullptr, mb;
+        for (uint8_t *type = g->types.base, *end = type + g->types.end, *next; type < end; )
             switch (*type) {
                 case Geometry::kMove:
                     if ((closed = (polygon || closeSubpath) && (sx != x0 || sy != y0)))
                         line(x0, y0, sx, sy, clip, unclipped, polygon, writer);
                     if (sx != FLT_MAX)
                         writer.EndSubpath(x0, y0, sx, sy, closeSubpath || closed);
-                    sx = x0 = p[0] * m.a + p[1] * m.c + m.tx, sy = y0 = p[0] * m.b + p[1] * m.d + m.ty, p += 2, type++, closeSubpath = false;
+                    closeSubpath = false;
+                    if (sizeof(P) == sizeof(uint16_t))
+                        mp = m.concat(Transform((qb->ux - qb->lx) / kQuantizedRange, 0.f, 0.f, (qb->uy - qb->ly) / kQuantizedRange, qb->lx, qb->ly)), qb++;
+                    if (molecule) {
+                        mb = Bounds(molecule->quad(m)), molecule++;
+                        e = 1.f + 1e-5f * fmaxf(fmaxf(fabsf(mb.lx), fabsf(mb.ux)), fmaxf(fabsf(mb.ly), fabsf(mb.uy)));
+                        if (mb.lx - e >= clip.ux || mb.ux + e <= clip.lx || mb.ly - e >= clip.uy || mb.uy + e <= clip.ly) {
+                            next = (uint8_t *)memchr(type + 1, Geometry::kMove, end - type - 1), next = next ?: end;
+                            p += (next - type) * 2, type = next, sx = sy = x0 = y0 = FLT_MAX;
+                            break;
+                        }
+                        unclipped = mb.lx - e >= clip.lx && mb.ux + e <= clip.ux && mb.ly - e >= clip.ly && mb.uy + e <= clip.uy;
+                    }
+                    sx = x0 = p[0] * mp.a + p[1] * mp.c + mp.tx, sy = y0 = p[0] * mp.b + p[1] * mp.d + mp.ty, p += 2, type++;
                     break;
                 case Geometry::kLine:
-                    x1 = p[0] * m.a + p[1] * m.c + m.tx, y1 = p[0] * m.b + p[1] * m.d + m.ty;
+                    x1 = p[0] * mp.a + p[1] * mp.c + mp.tx, y1 = p[0] * mp.b + p[1] * mp.d + mp.ty;
                     line(x0, y0, x1, y1, clip, unclipped, polygon, writer);
                     x0 = x1, y0 = y1, p += 2, type++;
                     break;
                 case Geometry::kQuadratic:
-                    x1 = p[0] * m.a + p[1] * m.c + m.tx, y1 = p[0] * m.b + p[1] * m.d + m.ty;
-                    x2 = p[2] * m.a + p[3] * m.c + m.tx, y2 = p[2] * m.b + p[3] * m.d + m.ty;
+                    x1 = p[0] * mp.a + p[1] * mp.c + mp.tx, y1 = p[0] * mp.b + p[1] * mp.d + mp.ty;
+                    x2 = p[2] * mp.a + p[3] * mp.c + mp.tx, y2 = p[2] * mp.b + p[3] * mp.d + mp.ty;
                     if (unclipped)
                         writer.Quadratic(x0, y0, x1, y1, x2, y2);
                     else {
@@ -657,9 +1457,9 @@ struct Rasterizer {
                     x0 = x2, y0 = y2, p += 4, type += 2;
                     break;
                 case Geometry::kCubic:
-                    x1 = p[0] * m.a + p[1] * m.c + m.tx, y1 = p[0] * m.b + p[1] * m.d + m.ty;
-                    x2 = p[2] * m.a + p[3] * m.c + m.tx, y2 = p[2] * m.b + p[3] * m.d + m.ty;
-                    x3 = p[4] * m.a + p[5] * m.c + m.tx, y3 = p[4] * m.b + p[5] * m.d + m.ty;
+                    x1 = p[0] * mp.a + p[1] * mp.c + mp.tx, y1 = p[0] * mp.b + p[1] * mp.d + mp.ty;
+                    x2 = p[2] * mp.a + p[3] * mp.c + mp.tx, y2 = p[2] * mp.b + p[3] * mp.d + mp.ty;
+                    x3 = p[4] * mp.a + p[5] * mp.c + mp.tx, y3 = p[4] * mp.b + p[5] * mp.d + mp.ty;
                     if (unclipped)
                         writer.Cubic(x0, y0, x1, y1, x2, y2, x3, y3);
                     else {
@@ -682,7 +1482,8 @@ struct Rasterizer {
             }
         if ((closed = (polygon || closeSubpath) && (sx != x0 || sy != y0)))
             line(x0, y0, sx, sy, clip, unclipped, polygon, writer);
-        writer.EndSubpath(x0, y0, sx, sy, closeSubpath || closed);
+        if (sx != FLT_MAX)
+            writer.EndSubpath(x0, y0, sx, sy, closeSubpath || closed);
     }
     static inline void line(float x0, float y0, float x1, float y1, Bounds clip, bool unclipped, bool polygon, GeometryWriter& writer) {
         if (unclipped)
@@ -843,8 +1644,23 @@ struct Rasterizer {
             }
         }
     }
+    //  A path's fat line height, a power of two from kMinFatline to kMaxFatline. Edge instances fall with the height as
+    //  its vertical travel over it, while their fragments grow with its horizontal travel times it, and faster where
+    //  dense rows merge cells, so steep, sparse paths get tall fat lines and shallow, dense ones short.
+    static inline float fatlineHeight(Geometry *g, Transform m) {
+        float x = fabsf(m.a) * g->travelx + fabsf(m.c) * g->travely, y = fabsf(m.b) * g->travelx + fabsf(m.d) * g->travely;
+        float density = x / fmaxf(1.f, g->bounds.width() * g->bounds.height() * fabsf(m.a * m.d - m.b * m.c)), fh, h = kMinFatline, cost = FLT_MAX, c;
+        for (fh = kMinFatline; fh <= kMaxFatline; fh *= 2.f)
+            if ((c = kEdgeInstanceFragments * y / fh + x * fh * (1.f + fh * density)) < cost)
+                cost = c, h = fh;
+        return h;
+    }
     struct CurveIndexer: GeometryWriter {
-        Segment *dst, *dst0;  bool fast;  Bounds clip;  Row<Sample> *samples;
+        Segment *dst, *dst0;  bool fast;  Bounds clip;  Row<Sample> *samples;  float fh = kfh, rfh = krfh;  uint32_t fatMask = kFatMask;
+        
+        void setHeight(float h) {
+            fh = h, rfh = 1.f / h, fatMask = ~(uint32_t(h) - 1);
+        }
         
         void writeSegment(float x0, float y0, float x1, float y1) {
             if (y0 != y1)
@@ -882,18 +1698,18 @@ struct Rasterizer {
             new (dst++) Segment(x0, y0, x1, y1, false);
             
             y0 -= clip.ly, y1 -= clip.ly;
-            if ((uint32_t(y0) & kFatMask) == (uint32_t(y1) & kFatMask))
-                new (samples[int(y0 * krfh)].alloc(1)) Sample(fminf(x0, x1), fmaxf(x0, x1), (y1 - y0) * kCoverScale, si);
+            if ((uint32_t(y0) & fatMask) == (uint32_t(y1) & fatMask))
+                new (samples->alloc(1)) Sample(fminf(x0, x1), fmaxf(x0, x1), (y1 - y0) * kCoverScale, si, y0 * rfh);
             else {
                 float lx, ux, ly, uy, iy, m, c, ny, minx, maxx, scale;
                 lx = fminf(x0, x1), ux = fmaxf(x0, x1);
                 ly = fminf(y0, y1), uy = fmaxf(y0, y1), scale = copysignf(kCoverScale, y1 - y0);
-                iy = floorf(ly * krfh), m = (x1 - x0) / (y1 - y0), c = x0 - m * y0, m *= kfh;
+                iy = floorf(ly * rfh), m = (x1 - x0) / (y1 - y0), c = x0 - m * y0, m *= fh;
                 minx = (iy + float(m < 0.f)) * m + c;
                 maxx = (iy + float(m > 0.f)) * m + c;
-                for (ny = iy * kfh; ly < uy; ly = ny, minx += m, maxx += m, iy++) {
-                    ny = fminf(uy, ny + kfh);
-                    new (samples[int(iy)].alloc(1)) Sample(fmaxf(lx, minx), fminf(ux, maxx), (ny - ly) * scale, si);
+                for (ny = iy * fh; ly < uy; ly = ny, minx += m, maxx += m, iy++) {
+                    ny = fminf(uy, ny + fh);
+                    new (samples->alloc(1)) Sample(fmaxf(lx, minx), fminf(ux, maxx), (ny - ly) * scale, si, iy);
                 }
             }
         }
@@ -905,106 +1721,163 @@ struct Rasterizer {
             new (dst++) Segment(x0, y0, x1, y1, true), new (dst++) Segment(x1, y1, x2, y2, false);
             
             y0 -= clip.ly, y1 -= clip.ly, y2 -= clip.ly;
-            if ((uint32_t(y0) & kFatMask) == (uint32_t(y2) & kFatMask))
-                new (samples[int(y0 * krfh)].alloc(1)) Sample(fminf(x0, x2), fmaxf(x0, x2), (y2 - y0) * kCoverScale, si);
+            if ((uint32_t(y0) & fatMask) == (uint32_t(y2) & fatMask))
+                new (samples->alloc(1)) Sample(fminf(x0, x2), fmaxf(x0, x2), (y2 - y0) * kCoverScale, si, y0 * rfh);
             else {
-                float ay, by, ax, bx, ly, uy, lx, ux, d2a, ity, iy, t, ny, sign = copysignf(1.f, y2 - y0);
+                float ay, by, ax, bx, ly, uy, lx, ux, d2a, d, iy, t, ny, sign = copysignf(1.f, y2 - y0);
                 ax = x2 - x1, bx = x1 - x0, ax -= bx, bx *= 2.f;
                 ay = y2 - y1, by = y1 - y0, ay -= by, by *= 2.f;
-                d2a = 0.5f / ay, ity = -by * d2a, d2a *= sign, sign *= kCoverScale;
+                d2a = 0.5f / ay, sign *= kCoverScale;
                 lx = y0 < y2 ? x0 : x2, ly = fminf(y0, y2), uy = fmaxf(y0, y2);
-                for (iy = floorf(ly * krfh), ny = iy * kfh; ly < uy; ly = ny, iy++, lx = ux) {
-                    ny = fminf(uy, ny + kfh);
-                    t = ay == 0 ? -(y0 - ny) / by : ity + sqrtf(fmaxf(0.f, by * by - 4.f * ay * (y0 - ny))) * d2a;
+                for (iy = floorf(ly * rfh), ny = iy * fh; ly < uy; ly = ny, iy++, lx = ux) {
+                    ny = fminf(uy, ny + fh);
+                    //  The stable form of the root where -by and d cancel, as they do for nearly straight quadratics
+                    d = copysignf(sqrtf(fmaxf(0.f, by * by - 4.f * ay * (y0 - ny))), y2 - y0);
+                    t = by * d > 0.f ? 2.f * (y0 - ny) / (-by - d) : ay == 0 ? -(y0 - ny) / by : (d - by) * d2a;
                     t = fmaxf(0.f, fminf(1.f, t)), ux = (ax * t + bx) * t + x0;
-                    new (samples[int(iy)].alloc(1)) Sample(fminf(lx, ux), fmaxf(lx, ux), (ny - ly) * sign, si);
+                    new (samples->alloc(1)) Sample(fminf(lx, ux), fmaxf(lx, ux), (ny - ly) * sign, si, iy);
                 }
             }
         }
     };
-    static void radixSort(uint32_t *in, int n, uint32_t lower, uint32_t range, bool single, uint16_t *counts) {
-        range = range < 4 ? 4 : range;
-        uint32_t tmp[n], mask = range - 1;
-        memset(counts, 0, sizeof(uint16_t) * range);
-        for (int i = 0; i < n; i++)
-            counts[(in[i] - lower) & mask]++;
-        uint64_t *sums = (uint64_t *)counts, sum = 0, count;
-        for (int i = 0; i < range / 4; i++) {
-            count = sums[i], sum += count + (count << 16) + (count << 32) + (count << 48), sums[i] = sum;
-            sum = sum & 0xFFFF000000000000, sum = sum | (sum >> 16) | (sum >> 32) | (sum >> 48);
-        }
-        for (int i = n - 1; i >= 0; i--)
-            tmp[--counts[(in[i] - lower) & mask]] = in[i];
-        if (single)
-            memcpy(in, tmp, n * sizeof(uint32_t));
-        else {
-            memset(counts, 0, sizeof(uint16_t) * 64);
-            for (int i = 0; i < n; i++)
-                counts[(in[i] >> 8) & 0x3F]++;
-            for (uint16_t *src = counts, *dst = src + 1, i = 1; i < 64; i++)
-                *dst++ += *src++;
-            for (int i = n - 1; i >= 0; i--)
-                in[--counts[(tmp[i] >> 8) & 0x3F]] = tmp[i];
-        }
+    //  A stable sort of a row's keys by the bits-wide x field above shift, of any size, using scratch for its second buffer.
+    //  The field is sorted as one digit of up to kRadixBits, or as two shorter ones for wide clips and short rows, with both
+    //  histograms counted in one pass.
+    static void radixSort(uint32_t *in, size_t n, uint32_t bits, uint32_t shift, Row<uint32_t>& scratch) {
+        uint32_t digit, passes, mask, counts0[1 << kRadixBits], counts1[1 << kRadixBits], *counts, sum, c, b, k, p;
+        passes = bits > kRadixBits || n < (1u << bits) / 4 ? 2 : 1, digit = (bits + passes - 1) / passes, mask = (1 << digit) - 1;
+        memset(counts0, 0, sizeof(uint32_t) << digit), memset(counts1, 0, sizeof(uint32_t) << digit);
+        size_t i;  uint32_t *src = in, *dst, *tmp;
+        if (passes == 1)
+            for (i = 0; i < n; i++)
+                counts0[(in[i] >> shift) & mask]++;
+        else
+            for (i = 0; i < n; i++)
+                k = in[i] >> shift, counts0[k & mask]++, counts1[(k >> digit) & mask]++;
+        scratch.empty(), dst = scratch.alloc(n);
+        for (p = 0; p < passes; p++, tmp = src, src = dst, dst = tmp) {
+            for (counts = p ? counts1 : counts0, sum = b = 0; b <= mask; b++)
+                c = counts[b], counts[b] = sum, sum += c;
+            for (i = 0; i < n; i++)
+                dst[counts[(src[i] >> (shift + p * digit)) & mask]++] = src[i];
+        }
+        if (src != in)
+            memcpy(in, src, n * sizeof(uint32_t));
     }
-    static void writeSegmentInstances(Bounds clip, bool even, size_t iz, bool opaque, bool fast, Context& ctx) {
-        size_t ily = 0, iuy = ceilf(clip.height() * krfh), iy, i, begin, size, edgeIz = iz | Instance::kEdge | even * Instance::kEvenOdd | fast * Instance::kFastEdges;
-        uint16_t counts[256], ly, uy, lx, ux;  float h, cover, winding, wscale;
-        Allocator::CountType type = fast ? Allocator::kFastEdges : Allocator::kQuadEdges;
-        bool single = clip.ux - clip.lx < 256.f;  Index *index;
-        uint32_t range = single ? powf(2.f, ceilf(log2f(clip.ux - clip.lx + 1.f))) : 256;
-        Row<Index> *indices = & ctx.indices;  Index *idx;
-        Row<Sample> *samples = & ctx.samples[0];  Sample *sample;
+    //  A path's samples are written to one stream, then their stream indices binned by fat line in a stable counting
+    //  sort, so row iy is binned[offsets[iy], offsets[iy + 1]) in the order it was written
+    static uint32_t *binSamples(size_t iuy, Context& ctx) {
+        size_t i, n = ctx.samples.end;  uint32_t *offsets, *binned, sum, c;  Sample *sample;
+        ctx.rowOffsets.empty(), ctx.binned.empty(), binned = ctx.binned.alloc(n);
+        offsets = (uint32_t *)memset(ctx.rowOffsets.alloc(iuy + 3), 0, (iuy + 3) * sizeof(uint32_t));
+        for (sample = ctx.samples.base, i = 0; i < n; i++, sample++)
+            offsets[sample->iy + 2]++;
+        for (sum = 0, i = 2; i < iuy + 3; i++)
+            c = offsets[i], offsets[i] = sum, sum += c;
+        for (sample = ctx.samples.base, i = 0; i < n; i++, sample++)
+            binned[offsets[sample->iy + 2]++] = uint32_t(i);
+        return offsets + 1;
+    }
+    static void writeSegmentInstances(Bounds clip, float fh, bool even, size_t iz, bool opaque, bool fast, Context& ctx) {
+        size_t iuy = ceilf(clip.height() / fh);  uint32_t *offsets = binSamples(iuy, ctx);
+        writeSegmentRows(clip, fh, even, iz, opaque, fast, 0, iuy, ctx.samples.base, ctx.binned.base, offsets, ctx.segments.idx, ctx.indices, ctx.scratch, ctx.blends, ctx.opaques, ctx.segmentsIndices, & ctx.allocator);
+        ctx.samples.empty();
+    }
+    //  Bands of fat lines are sorted and walked in parallel, then stitched in order, replaying atlas allocation serially
+    static void writeBandedSegmentInstances(Bounds clip, float fh, bool even, size_t iz, bool opaque, bool fast, Context& ctx) {
+        struct Info { Bounds clip;  float fh;  bool even, opaque, fast;  size_t iz, iuy;  uint32_t *offsets;  Context *ctx; };
+        Info info = { clip, fh, even, opaque, fast, iz, size_t(ceilf(clip.height() / fh)), nullptr, & ctx };
+        info.offsets = binSamples(info.iuy, ctx);
+        size_t count = (info.iuy + kBandFatlines - 1) / kBandFatlines, i, siBase;
+        if (ctx.bands.size() < count)
+            ctx.bands.resize(count);
+        (*ctx.apply)(ctx.jobs, count, [](size_t i, void *p) {
+            Info& info = *(Info *)p;  Context::Band& band = info.ctx->bands[i];
+            size_t ily = i * kBandFatlines, iuy = ily + kBandFatlines < info.iuy ? ily + kBandFatlines : info.iuy;
+            band.blends.empty(), band.opaques.empty(), band.segmentsIndices.empty();
+            writeSegmentRows(info.clip, info.fh, info.even, info.iz, info.opaque, info.fast, ily, iuy, info.ctx->samples.base, info.ctx->binned.base, info.offsets, info.ctx->segments.idx, band.indices, band.scratch, band.blends, band.opaques, band.segmentsIndices, nullptr);
+        }, & info);
+        ctx.samples.empty();
         
-        for (iy = ily; iy < iuy; iy++, samples->empty(), samples++, indices->empty()) {
-            if ((size = samples->end)) {
-                for (sample = samples->base, idx = indices->alloc(size), i = 0; i < size; i++, sample++) {
-                    if (sample->cover)
-                        idx->x = sample->lx, idx->i = i, idx++;
+        Allocator::CountType type = fast ? Allocator::kFastEdges : Allocator::kQuadEdges;
+        for (i = 0; i < count; i++) {
+            Context::Band& band = ctx.bands[i];
+            siBase = ctx.segmentsIndices.end;
+            memcpy(ctx.segmentsIndices.alloc(band.segmentsIndices.end), band.segmentsIndices.base, band.segmentsIndices.end * sizeof(uint32_t));
+            memcpy(ctx.opaques.alloc(band.opaques.end), band.opaques.base, band.opaques.end * sizeof(Instance));
+            Blend *inst = (Blend *)memcpy(ctx.blends.alloc(band.blends.end), band.blends.base, band.blends.end * sizeof(Blend));
+            for (Blend *end = ctx.blends.base + ctx.blends.end; inst < end; inst++)
+                if (inst->iz & Instance::kEdge) {
+                    Cell *cell = & inst->quad.cell;
+                    inst->data.idx += int(siBase);
+                    ctx.allocator.alloc(cell->lx, cell->ly, cell->ux, cell->uy, inst - ctx.blends.base, cell, type, (inst->data.count + 1) / 2);
                 }
-                size = idx - indices->base;
-                if (size > 32 && size < 65536)
-                    radixSort((uint32_t *)indices->base, int(size), single ? clip.lx : 0, range, single, counts);
+        }
+    }
+    static void writeSegmentRows(Bounds clip, float fh, bool even, size_t iz, bool opaque, bool fast, size_t ily, size_t iuy, Sample *samples, uint32_t *binned, uint32_t *offsets, size_t base, Row<uint32_t>& indices, Row<uint32_t>& scratch, Row<Blend>& blends, Row<Instance>& opaques, Row<uint32_t>& segmentsIndices, Allocator *allocator) {
+        size_t iy, i, begin, size, edgeIz = iz | Instance::kEdge | even * Instance::kEvenOdd | fast * Instance::kFastEdges;
+        uint16_t ly, uy, lx, ux, x;  float h, cover, winding, wscale;
+        Allocator::CountType type = fast ? Allocator::kFastEdges : Allocator::kQuadEdges;
+        uint32_t lower = clip.lx, width = ceilf(clip.ux) - lower, bits = 2, shift, mask;
+        uint32_t *key, *index, *row;  Sample *sample;  bool packed;
+        //  A row is sorted as 32-bit keys of each sample's x from the clip's left above its place in the row, so equal x keep
+        //  their order. A row with more samples than the low bits can count is sorted by a stable comparison instead.
+        while (bits < 16 && (1u << bits) <= width)
+            bits++;
+        shift = 32 - bits;
+        for (iy = ily; iy < iuy; iy++, indices.empty()) {
+            if ((size = offsets[iy + 1] - offsets[iy])) {
+                row = binned + offsets[iy], packed = size <= (size_t(1) << shift), mask = packed ? (1u << shift) - 1 : ~0u;
+                for (key = indices.alloc(size), i = 0; i < size; i++)
+                    if ((sample = samples + row[i])->cover)
+                        *key++ = packed ? (uint32_t(sample->lx) - lower) << shift | uint32_t(i) : uint32_t(i);
+                size = key - indices.base;
+                if (!packed)
+                    std::stable_sort(indices.base, indices.base + size, [&](uint32_t a, uint32_t b) { return samples[row[a]].lx < samples[row[b]].lx; });
+                else if (size > 32)
+                    radixSort(indices.base, size, bits, shift, scratch);
                 else
-                    std::sort(indices->base, indices->base + size);
+                    std::sort(indices.base, indices.base + size);
                 
-                size_t siBase = ctx.segmentsIndices.end;
-                uint32_t *si = ctx.segmentsIndices.alloc(size);
+                size_t siBase = segmentsIndices.end;
+                uint32_t *si = segmentsIndices.alloc(size);
                 
-                ly = iy * kfh + clip.ly, ly = ly < clip.ly ? clip.ly : ly > clip.uy ? clip.uy : ly;
-                uy = (iy + 1) * kfh + clip.ly, uy = uy < clip.ly ? clip.ly : uy > clip.uy ? clip.uy : uy;
-                for (h = uy - ly, wscale = 0.00003051850948f * kfh / h, cover = winding = 0.f, index = indices->base, lx = ux = index->x, i = begin = 0; i < size; i++, index++) {
-                    if (index->x >= ux && fabsf((winding - floorf(winding)) - 0.5f) > 0.499f) {
-                        if (lx != ux) {
-                            Blend *inst = new (ctx.blends.alloc(1)) Blend(edgeIz);
-                            ctx.allocator.alloc(lx, ly, ux, uy, ctx.blends.end - 1, & inst->quad.cell, type, (i - begin + 1) / 2);
-                            inst->quad.cover = short(cover), inst->quad.base = int(ctx.segments.idx), inst->data.count = int(i - begin), inst->data.idx = int(siBase + begin);
-                        }
+                ly = iy * fh + clip.ly, ly = ly < clip.ly ? clip.ly : ly > clip.uy ? clip.uy : ly;
+                uy = (iy + 1) * fh + clip.ly, uy = uy < clip.ly ? clip.ly : uy > clip.uy ? clip.uy : uy;
+                for (h = uy - ly, wscale = 0.00003051850948f * kfh / h, cover = winding = 0.f, index = indices.base, lx = ux = 0, i = begin = 0; i < size; i++, index++) {
+                    sample = samples + row[*index & mask], x = sample->lx;
+                    if (x >= ux && fabsf((winding - floorf(winding)) - 0.5f) > 0.499f) {
+                        if (lx != ux)
+                            writeEdgeInstance(lx, ly, ux, uy, edgeIz, cover, base, i - begin, siBase + begin, type, blends, allocator);
                         winding = cover = truncf(winding + copysign(0.5f, winding));
                         if ((even && (int(winding) & 1)) || (!even && winding)) {
                             if (opaque) {
-                                Cell *cell = & (new (ctx.opaques.alloc(1)) Instance(iz))->quad.cell;
-                                cell->lx = ux, cell->ly = ly, cell->ux = index->x, cell->uy = uy;
+                                Cell *cell = & (new (opaques.alloc(1)) Instance(iz))->quad.cell;
+                                cell->lx = ux, cell->ly = ly, cell->ux = x, cell->uy = uy;
                             } else {
-                                Cell *cell = & (new (ctx.blends.alloc(1)) Blend(iz))->quad.cell;
-                                cell->lx = ux, cell->ly = ly, cell->ux = index->x, cell->uy = uy, cell->ox = kNullIndex;
+                                //  A solid cell, ox == kNullIndex, with oy == kNullIndex for full alpha: see the LOD quads in drawList
+                                Cell *cell = & (new (blends.alloc(1)) Blend(iz))->quad.cell;
+                                cell->lx = ux, cell->ly = ly, cell->ux = x, cell->uy = uy, cell->ox = cell->oy = kNullIndex;
                             }
                         }
-                        begin = i, lx = ux = index->x;
+                        begin = i, lx = ux = x;
                     }
-                    sample = samples->base + index->i;
                     ux = sample->ux > ux ? sample->ux : ux, winding += sample->cover * wscale;
                     si[i] = sample->is;
                 }
-                if (lx != ux) {
-                    Blend *inst = new (ctx.blends.alloc(1)) Blend(edgeIz);
-                    ctx.allocator.alloc(lx, ly, ux, uy, ctx.blends.end - 1, & inst->quad.cell, type, (i - begin + 1) / 2);
-                    inst->quad.cover = short(cover), inst->quad.base = int(ctx.segments.idx), inst->data.count = int(i - begin),
-                    inst->data.idx = int(siBase + begin);
-                }
+                if (lx != ux)
+                    writeEdgeInstance(lx, ly, ux, uy, edgeIz, cover, base, i - begin, siBase + begin, type, blends, allocator);
             }
         }
     }
+    static inline void writeEdgeInstance(uint16_t lx, uint16_t ly, uint16_t ux, uint16_t uy, size_t edgeIz, float cover, size_t base, size_t count, size_t idx, Allocator::CountType type, Row<Blend>& blends, Allocator *allocator) {
+        Blend *inst = new (blends.alloc(1)) Blend(edgeIz);
+        if (allocator)
+            allocator->alloc(lx, ly, ux, uy, blends.end - 1, & inst->quad.cell, type, (count + 1) / 2);
+        else
+            inst->quad.cell.lx = lx, inst->quad.cell.ly = ly, inst->quad.cell.ux = ux, inst->quad.cell.uy = uy;
+        inst->quad.cover = short(cover), inst->quad.base = int(base), inst->data.count = int(count), inst->data.idx = int(idx);
+    }
     struct SegmentCounter: GeometryWriter {
         void writeSegment(float x0, float y0, float x1, float y1) { count += 1; }
         void Quadratic(float x0, float y0, float x1, float y1, float x2, float y2) { count += 2; }
@@ -1041,42 +1914,92 @@ struct Rasterizer {
         }
         uint32_t iz;  Instance *dst0, *dst;
     };
+    //  A context's segment window holds a quarter more than its peak last frame, so it rarely overflows into a copy.
+    static size_t reserveSegmentWindows(Context *contexts, size_t count, bool direct) {
+        size_t size = 0, n;
+        for (Context *ctx = contexts, *last = ctx + count; ctx < last; ctx++)
+            n = ctx->segmentsPeak, ctx->window = size, ctx->windowSize = direct && n ? n + n / 4 : 0, size += ctx->windowSize * sizeof(Segment);
+        return size;
+    }
+    //  A compact header is laid out here, once each context's visible paths are known, with the contexts' rows in z order.
+    //  Point pool slots are found here too, as they are shared between contexts. A context draws from the pool only if
+    //  every one of its uploads found a slot.
     static size_t resizeBuffer(SceneList& list, Context *contexts, size_t count, size_t *begins, Buffer& buffer) {
-        size_t size = buffer.headerSize, begin = buffer.headerSize, end = begin, sz, i, j, instances;
-        for (i = 0; i < count; i++)
+        size_t size, begin, end, sz, i, j, instances, paths = 0;  int slot;
+        if (buffer.compact) {
+            for (i = 0; i < count; i++)
+                contexts[i].headerBase = paths, paths += contexts[i].header.paths.end;
+            buffer.layout(paths), buffer.paths.empty().alloc(paths);
+        }
+        buffer.poolSlots.empty();
+        for (Context *ctx = contexts, *last = ctx + count; ctx < last; ctx++) {
+            ctx->pooled = buffer.pool.ptr;
+            for (Upload *upload = ctx->uploads.base, *end = upload + ctx->uploads.end; buffer.pool.ptr && upload < end; upload++)
+                if ((slot = buffer.pool->alloc(upload->g, *upload)) < 0)
+                    ctx->pooled = false;
+                else
+                    *buffer.poolSlots.alloc(1) = PointPool::Use{ uint32_t(slot), buffer.pool->slots[slot].generation };
+            if (buffer.pool.ptr && !ctx->pooled)
+                buffer.pool->copied += ctx->p16total * sizeof(Point16);
+        }
+        for (size = begin = end = buffer.headerSize, i = 0; i < count; i++)
             size += contexts[i].opaques.end * sizeof(Instance);
         Context *ctx = contexts;   Allocator::Pass *pass;
         for (ctx = contexts, i = 0; i < count; i++, ctx++) {
             for (instances = 0, pass = ctx->allocator.passes.base, j = 0; j < ctx->allocator.passes.end; j++, pass++)
                 instances += pass->count();
-            begins[i] = size, size += instances * sizeof(Edge) + (ctx->outlineInstances - ctx->outlinePaths + ctx->blends.end) * sizeof(Instance) + ctx->segments.end * sizeof(Segment) + ctx->p16total * sizeof(Point16);
+            begins[i] = size, size += instances * sizeof(Edge) + (ctx->outlineInstances - ctx->outlinePaths + ctx->blends.end) * sizeof(Instance) + (ctx->segmentsInWindow() ? 0 : ctx->segments.end) * sizeof(Segment) + (ctx->pooled ? 0 : ctx->p16total) * sizeof(Point16);
         }
-        buffer.resize(size, buffer.headerSize);
+        buffer.resize(size, buffer.compact ? buffer.windows : buffer.headerSize);
+        //  The windows move with the buffer
+        for (ctx = contexts, i = 0; i < count; i++, ctx++)
+            if (ctx->segmentsInWindow())
+                ctx->segments.memory->addr = ctx->segments.base = (Segment *)(buffer.base + ctx->window);
         for (i = 0; i < count; i++)
-            if ((sz = contexts[i].opaques.end * sizeof(Instance)))
-                memcpy(buffer.base + end, contexts[i].opaques.base, sz), end += sz;
+            if ((sz = contexts[i].opaques.end * sizeof(Instance))) {
+                memcpy(buffer.base + end, contexts[i].opaques.base, sz);
+                if (buffer.compact)
+                    for (Instance *inst = (Instance *)(buffer.base + end), *last = inst + contexts[i].opaques.end; inst < last; inst++)
+                        inst->iz += contexts[i].headerBase;
+                end += sz;
+            }
         if (begin != end)
             new (buffer.entries.alloc(1)) Buffer::Entry(Buffer::kOpaques, begin, end);
         return size;
     }
     static void writeContextToBuffer(SceneList& list, Context *ctx, size_t begin, Buffer& buffer) {
-        size_t i, j, count, size, ip, iz, is, lz, ic, end, pbase = 0, instbegin, passsize;
+        size_t j, count, size, ip, iz, ic, end, pbase = 0, instbegin, passsize, hz = buffer.compact ? ctx->headerBase : 0;
+        Buffer::Header& header = ctx->header;
+        if (buffer.compact && (count = header.paths.end)) {
+            memcpy(buffer.paths.base + hz, header.paths.base, count * sizeof(uint32_t));
+            memcpy((Colorant *)(buffer.base + buffer.colors) + hz, header.colors.base, count * sizeof(Colorant));
+            memcpy((Transform *)(buffer.base + buffer.ctms) + hz, header.ctms.base, count * sizeof(Transform));
+            memcpy((Transform *)(buffer.base + buffer.clips) + hz, header.clips.base, count * sizeof(Transform));
+            memcpy((float *)(buffer.base + buffer.widths) + hz, header.widths.base, count * sizeof(float));
+            memcpy((Bounds *)(buffer.base + buffer.bounds) + hz, header.bounds.base, count * sizeof(Bounds));
+        }
         if (ctx->segments.end || ctx->p16total) {
-            size = ctx->segments.end * sizeof(Segment), end = begin + size;
-            ctx->entries.emplace_back(Buffer::kSegmentsBase, begin, end);
-            memcpy(buffer.base + begin, ctx->segments.base, size), begin = end;
+            size = ctx->segments.end * sizeof(Segment);
+            if (ctx->segmentsInWindow())
+                ctx->entries.emplace_back(Buffer::kSegmentsBase, ctx->window, ctx->window + size), end = begin;
+            else
+                ctx->entries.emplace_back(Buffer::kSegmentsBase, begin, begin + size), memcpy(buffer.base + begin, ctx->segments.base, size), begin = end = begin + size;
             
-            for (pbase = 0, i = lz = 0; i < list.scenes.size(); lz += list.scenes[i].count, i++)
-                for (count = list.scenes[i].count, is = 0; is < count; is++)
-                    if (ctx->fasts.base[lz + is]) {
-                        Geometry *g = list.scenes[i].paths->base[is].ptr;
-                        size = g->p16s.end * sizeof(Point16);
-                        memcpy(buffer.base + end, g->p16s.base, size);
-                        end += size, ctx->fasts.base[lz + is] = uint32_t(pbase), pbase += g->p16s.end;
-                    }
-            ctx->entries.emplace_back(Buffer::kPointsBase, begin, end), begin = end;
+            for (Upload *upload = ctx->uploads.base, *last = upload + ctx->uploads.end; upload < last; upload++) {
+                size = upload->g->p16s.end * sizeof(Point16);
+                if (upload->fresh)
+                    memcpy(buffer.pool->base + upload->slot, upload->g->p16s.base, size);
+                if (ctx->pooled)
+                    upload->base = upload->slot;
+                else
+                    memcpy(buffer.base + end, upload->g->p16s.base, size), end += size, upload->base = uint32_t(pbase), pbase += upload->g->p16s.end;
+            }
+            if (ctx->pooled)
+                ctx->entries.emplace_back(Buffer::kPointPoolBase, 0, 0);
+            else
+                ctx->entries.emplace_back(Buffer::kPointsBase, begin, end), begin = end;
         }
-        Transform *ctms = (Transform *)(buffer.base + buffer.ctms);
+        Transform *ctms = buffer.compact ? header.ctms.base : (Transform *)(buffer.base + buffer.ctms);
         Edge *quadEdge = nullptr, *fastEdge = nullptr, *fastMolecule = nullptr, *fastMolecule0 = nullptr, *quadMolecule = nullptr, *quadMolecule0 = nullptr;
         for (count = ctx->allocator.passes.end, ip = 0; ip < count; ip++) {
             Allocator::Pass *pass = ctx->allocator.passes.base + ip;
@@ -1104,17 +2027,17 @@ struct Rasterizer {
                 iz = inst->iz & kPathIndexMask;
                 Geometry *g = inst->g;
                 if (inst->iz & Instance::kOutlines) {
-                    outliner.iz = inst->iz, outliner.dst = outliner.dst0 = dst, outliner.oddCubics = 1.f;
+                    outliner.iz = uint32_t(inst->iz + hz), outliner.dst = outliner.dst0 = dst, outliner.oddCubics = 1.f;
                     divideGeometry(g, ctms[iz], inst->clip, inst->clip.isHuge(), false, outliner);
                     dst = outliner.dst;
                 } else {
-                    ic = dst - dst0, dst->iz = inst->iz, dst->quad = inst->quad, dst++;
+                    ic = dst - dst0, dst->iz = uint32_t(inst->iz + hz), dst->quad = inst->quad, dst++;
                     bool fast = inst->iz & Instance::kFastEdges;
                     if (inst->iz & Instance::kMolecule) {
                         uint16_t ux = inst->quad.cell.ux;  Transform& ctm = ctms[iz];
                         float *molx = (float *)g->molecules.base + (ctm.a > 0.f ? 2 : 0), *moly = (float *)g->molecules.base + (ctm.c > 0.f ? 3 : 1);
                         Edge *molecule = fast ? fastMolecule : quadMolecule;
-                        dst[-1].quad.base = int(ctx->fasts.base[iz]);
+                        dst[-1].quad.base = int(ctx->uploads.base[inst->quad.base].base);
                         dst[-1].quad.biid = int(molecule - (fast ? fastMolecule0 : quadMolecule0));
                         bool hasMolecules = g->molecules.end > 1, update = hasMolecules;
                         if (fast) {
@@ -1150,5 +2073,108 @@ struct Rasterizer {
                 end = begin + size * sizeof(Instance), ctx->entries.emplace_back(Buffer::kInstances, begin, end), begin = end;
         }
     }
+    //  Writes a finished buffer's header and entries in the compact encoding, and the compact entries, with their offsets
+    //  in dst, to entries. Instance base markers move with their instances.
+    static size_t writeCompactBuffer(Buffer& buffer, Row<uint8_t>& dst, Row<Buffer::Entry>& entries) {
+        size_t header = buffer.headerSize - buffer.colors, begin, i, j;
+        dst.empty(), entries.empty(), memcpy(dst.alloc(header), buffer.base + buffer.colors, header);
+        for (Buffer::Entry *entry = buffer.entries.base, *last = entry + buffer.entries.end; entry < last; entry++) {
+            begin = dst.end;
+            if (entry->type == Buffer::kSegmentsBase)
+                writeCompactSegments((Segment *)(buffer.base + entry->begin), (Segment *)(buffer.base + entry->end), dst);
+            else if (entry->type == Buffer::kInstances || entry->type == Buffer::kOpaques)
+                writeCompactInstances((Instance *)(buffer.base + entry->begin), (Instance *)(buffer.base + entry->end), dst);
+            else if (entry->type != Buffer::kPointPoolBase && entry->type != Buffer::kInstancesBase)
+                memcpy(dst.alloc(entry->end - entry->begin), buffer.base + entry->begin, entry->end - entry->begin);
+            new (entries.alloc(1)) Buffer::Entry(entry->type, begin, dst.end);
+        }
+        for (i = 0; i < entries.end; i++)
+            if (entries.base[i].type == Buffer::kInstancesBase)
+                for (entries.base[i].end = 0, j = i + 1; j < entries.end; j++)
+                    if (buffer.entries.base[j].type == Buffer::kInstances && buffer.entries.base[j].begin == buffer.entries.base[i].begin) {
+                        entries.base[i].begin = entries.base[j].begin;
+                        break;
+                    }
+        return dst.end;
+    }
+    //  A run grows while its bounds fit, or, for a run of floats, while the next segment does not fit alone
+    static void writeCompactSegments(Segment *s, Segment *end, Row<uint8_t>& dst) {
+        Segment *e;  Bounds b, eb;  bool floats;
+        for (; s < end; s = e) {
+            for (b = SegmentFrame::bounds(*s), floats = !SegmentFrame::fits(b), e = s + 1; e < end; e++) {
+                eb = SegmentFrame::bounds(*e);
+                if (floats ? SegmentFrame::fits(eb) : (eb.extend(b), !SegmentFrame::fits(eb)))
+                    break;
+                b = eb;
+            }
+            SegmentFrame frame(b, e - s, floats);  *(SegmentFrame *)dst.alloc(sizeof(SegmentFrame)) = frame;
+            if (floats)
+                memcpy(dst.alloc((e - s) * sizeof(Segment)), s, (e - s) * sizeof(Segment));
+            else
+                for (Segment16 *s16 = (Segment16 *)dst.alloc((e - s) * sizeof(Segment16)); s < e; s++, s16++)
+                    *s16 = frame.encode(*s);
+        }
+    }
+    static void writeCompactInstances(Instance *begin, Instance *end, Row<uint8_t>& dst) {
+        size_t count = end - begin, outlines = 0, words, i;  Instance *inst;  uint32_t *counts;
+        for (inst = begin; inst < end; inst++)
+            outlines += bool(inst->iz & Instance::kOutlines);
+        words = outlines && outlines < count ? (count + 31) / 32 : 0;
+        counts = (uint32_t *)dst.alloc((2 + words) * sizeof(uint32_t)), counts[0] = uint32_t(count - outlines), counts[1] = uint32_t(outlines);
+        for (memset(counts + 2, 0, words * sizeof(uint32_t)), i = 0; words && i < count; i++)
+            counts[2 + i / 32] |= bool(begin[i].iz & Instance::kOutlines) << (i & 31);
+        for (inst = begin; counts[0] && inst < end; inst++)
+            if ((inst->iz & Instance::kOutlines) == 0)
+                memcpy(dst.alloc(sizeof(QuadInstance)), inst, sizeof(QuadInstance));
+        for (inst = begin; outlines && inst < end; inst++)
+            if (inst->iz & Instance::kOutlines)
+                memcpy(dst.alloc(sizeof(Instance)), inst, sizeof(Instance));
+    }
+    //  Decodes a compact buffer into the float form, its header at 0 and its entries' offsets in dst, so every record
+    //  other than segments reads back exactly
+    static size_t readCompactBuffer(uint8_t *src, size_t header, Row<Buffer::Entry>& entries, Row<uint8_t>& dst, Row<Buffer::Entry>& dstEntries) {
+        size_t begin, i, j;
+        dst.empty(), dstEntries.empty(), memcpy(dst.alloc(header), src, header);
+        for (Buffer::Entry *entry = entries.base, *last = entry + entries.end; entry < last; entry++) {
+            begin = dst.end;
+            if (entry->type == Buffer::kSegmentsBase)
+                readCompactSegments(src + entry->begin, src + entry->end, dst);
+            else if (entry->type == Buffer::kInstances || entry->type == Buffer::kOpaques)
+                readCompactInstances(src + entry->begin, dst);
+            else if (entry->type != Buffer::kPointPoolBase && entry->type != Buffer::kInstancesBase)
+                memcpy(dst.alloc(entry->end - entry->begin), src + entry->begin, entry->end - entry->begin);
+            new (dstEntries.alloc(1)) Buffer::Entry(entry->type, begin, dst.end);
+        }
+        for (i = 0; i < entries.end; i++)
+            if (entries.base[i].type == Buffer::kInstancesBase)
+                for (dstEntries.base[i].end = 0, j = i + 1; j < entries.end; j++)
+                    if (entries.base[j].type == Buffer::kInstances && entries.base[j].begin == entries.base[i].begin) {
+                        dstEntries.base[i].begin = dstEntries.base[j].begin;
+                        break;
+                    }
+        return dst.end;
+    }
+    static void readCompactSegments(uint8_t *src, uint8_t *end, Row<uint8_t>& dst) {
+        SegmentFrame *frame;  size_t count;
+        for (; src < end; src += count * (frame->count & SegmentFrame::kFloats ? sizeof(Segment) : sizeof(Segment16))) {
+            frame = (SegmentFrame *)src, src += sizeof(SegmentFrame), count = frame->count & ~SegmentFrame::kFloats;
+            if (frame->count & SegmentFrame::kFloats)
+                memcpy(dst.alloc(count * sizeof(Segment)), src, count * sizeof(Segment));
+            else {
+                Segment *s = (Segment *)dst.alloc(count * sizeof(Segment));
+                for (Segment16 *s16 = (Segment16 *)src, *end16 = s16 + count; s16 < end16; s16++, s++)
+                    *s = frame->decode(*s16);
+            }
+        }
+    }
+    static void readCompactInstances(uint8_t *src, Row<uint8_t>& dst) {
+        uint32_t *counts = (uint32_t *)src, quads = counts[0], outlines = counts[1], count = quads + outlines, words = outlines && quads ? (count + 31) / 32 : 0, i;
+        QuadInstance *quad = (QuadInstance *)(counts + 2 + words);  Instance *outline = (Instance *)(quad + quads), *inst = (Instance *)dst.alloc(count * sizeof(Instance));
+        for (i = 0; i < count; i++, inst++)
+            if (words ? (counts[2 + i / 32] >> (i & 31)) & 1 : outlines)
+                *inst = *outline++;
+            else
+                memset(inst, 0, sizeof(Instance)), memcpy(inst, quad++, sizeof(QuadInstance));
+    }
 };
 typedef Rasterizer Ra;
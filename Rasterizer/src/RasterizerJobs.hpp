@@ -0,0 +1,148 @@
+//
+//  Copyright 2025 Nigel Timothy Barber - nigel@mindbrix.co.uk
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty. In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for personal use
+//  (for a commercial licence please contact the author), and to alter it and
+//  redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//  claim that you wrote the original software. If you use this software
+//  in a product, an acknowledgment in the product documentation would be
+//  appreciated but is not required.
+//  2. Altered source versions must be plainly marked as such, and must not be
+//  misrepresented as being the original software.
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#import <algorithm>
+#import <atomic>
+#import <condition_variable>
+#import <mutex>
+#import <thread>
+#import <vector>
+
+//  A portable dispatch_apply. Each apply is a batch of job indices, split per worker into [begin, end) ranges packed in
+//  one atomic word: the owner pops from the front, idle workers steal from the back. The calling thread works on its
+//  own batch, so apply may be nested inside a job.
+
+struct RasterizerJobs {
+    typedef void (*Function)(size_t i, void *info);
+
+    struct Queue {
+        inline bool pop(size_t& i) {
+            uint64_t r = range.load(std::memory_order_relaxed), begin, end;
+            do {
+                begin = r & 0xFFFFFFFF, end = r >> 32;
+                if (begin >= end)
+                    return false;
+            } while (!range.compare_exchange_weak(r, (begin + 1) | (end << 32), std::memory_order_acquire, std::memory_order_relaxed));
+            i = size_t(begin);
+            return true;
+        }
+        inline bool steal(size_t& i) {
+            uint64_t r = range.load(std::memory_order_relaxed), begin, end;
+            do {
+                begin = r & 0xFFFFFFFF, end = r >> 32;
+                if (begin >= end)
+                    return false;
+            } while (!range.compare_exchange_weak(r, begin | ((end - 1) << 32), std::memory_order_acquire, std::memory_order_relaxed));
+            i = size_t(end - 1);
+            return true;
+        }
+        inline bool isEmpty() const {
+            uint64_t r = range.load(std::memory_order_relaxed);
+            return (r & 0xFFFFFFFF) >= (r >> 32);
+        }
+        std::atomic<uint64_t> range = { 0 };  char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    struct Batch {
+        bool isClaimable() const {
+            for (auto& queue : queues)
+                if (!queue.isEmpty())
+                    return true;
+            return false;
+        }
+        void work(size_t index) {
+            size_t n = queues.size(), i, j;
+            for (;;) {
+                bool found = queues[index].pop(i);
+                for (j = 1; !found && j < n; j++)
+                    found = queues[(index + j) % n].steal(i);
+                if (!found)
+                    return;
+                (*function)(i, info);
+                remaining.fetch_sub(1, std::memory_order_release);
+            }
+        }
+        Function function;  void *info;  std::atomic<size_t> remaining = { 0 }, users = { 0 };  std::vector<Queue> queues;
+    };
+    ~RasterizerJobs() { stop(); }
+
+    void start(size_t count) {
+        stop();
+        threads.reserve(count = count ?: std::thread::hardware_concurrency() ?: 1), quit = false;
+        for (size_t i = 1; i < count; i++)
+            threads.emplace_back(& RasterizerJobs::run, this, i);
+        size = count;
+    }
+    void stop() {
+        { std::lock_guard<std::mutex> lock(mutex);  quit = true; }
+        wake.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+        threads.clear(), size = 0;
+    }
+    size_t threadCount() {
+        if (size == 0)
+            start(0);
+        return size;
+    }
+    template<typename F>
+    void apply(size_t count, F fn) {
+        apply(count, [](size_t i, void *info) { (*(F *)info)(i); }, & fn);
+    }
+    void apply(size_t count, Function fn, void *info) {
+        size_t n = threadCount(), i;
+        if (n == 1 || count < 2) {
+            for (i = 0; i < count; i++)
+                (*fn)(i, info);
+            return;
+        }
+        Batch batch;  batch.function = fn, batch.info = info, batch.remaining = count, batch.queues = std::vector<Queue>(n);
+        for (i = 0; i < n; i++)
+            batch.queues[i].range.store(uint64_t(count * i / n) | (uint64_t(count * (i + 1) / n) << 32), std::memory_order_relaxed);
+        { std::lock_guard<std::mutex> lock(mutex);  batches.emplace_back(& batch), generation++; }
+        wake.notify_all();
+        batch.work(workerIndex() % n);
+        while (batch.remaining.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        { std::lock_guard<std::mutex> lock(mutex);  batches.erase(std::find(batches.begin(), batches.end(), & batch)); }
+        while (batch.users.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    void run(size_t index) {
+        workerIndex() = index;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t seen = 0; !quit; ) {
+            Batch *batch = nullptr;
+            for (auto it = batches.rbegin(); batch == nullptr && it != batches.rend(); it++)
+                if ((*it)->isClaimable())
+                    batch = *it, batch->users++;
+            if (batch)
+                lock.unlock(), batch->work(index), batch->users.fetch_sub(1, std::memory_order_release), lock.lock();
+            else
+                wake.wait(lock, [&] { return quit || generation != seen; }), seen = generation;
+        }
+    }
+    static size_t& workerIndex() {
+        static thread_local size_t index = 0;
+        return index;
+    }
+    size_t refCount, size = 0, generation = 0;
+    std::vector<Batch *> batches;  std::vector<std::thread> threads;
+    std::mutex mutex;  std::condition_variable wake;  bool quit = false;
+};
@@ -87,8 +87,10 @@ struct RasterizerPDF {
     };
     
     static bool pathIsRect(Ra::Path p) {
-        float *pts = p->points.base, ax, ay, bx, by, t0, t1;
-        if (p->types.end != 6 || p->counts[Ra::Geometry::kLine] != 4 || pts[0] != pts[10] || pts[1] != pts[11])
+        if (p->types.end != 6 || p->counts[Ra::Geometry::kLine] != 4)
+            return false;
+        Ra::Row<float> decoded;  float *pts = p->decodedPoints(decoded), ax, ay, bx, by, t0, t1;
+        if (pts[0] != pts[10] || pts[1] != pts[11])
             return false;
         ax = pts[2] - pts[0], ay = pts[3] - pts[1], bx = pts[4] - pts[2], by = pts[5] - pts[3];
         t0 = (ax * bx + ay * by) / (ax * ax + ay * ay);
@@ -191,7 +193,9 @@ struct RasterizerPDF {
         return doc ? FPDF_GetPageCount(doc) : 0;
     }
     
-    static Ra::SceneList writeSceneList(const void *bytes, size_t size, size_t pageIndex) {
+    //  A maxZoom quantizes points that hold to kQuantizedError pixels at up to that zoom of the page's points, which the
+    //  page transform only rotates and moves
+    static Ra::SceneList writeSceneList(const void *bytes, size_t size, size_t pageIndex, Ra::Ref<Ra::Arena> arena = Ra::Ref<Ra::Arena>(), float maxZoom = 0.f) {
         Ra::SceneList list;
         FPDF_LIBRARY_CONFIG config;
             config.version = 3;
@@ -209,7 +213,7 @@ struct RasterizerPDF {
                 FPDF_PAGE page = FPDF_LoadPage(doc, int(pageIndex));
                 FPDF_TEXTPAGE text_page = FPDFText_LoadPage(page);
                 
-                Ra::Scene scene;
+                Ra::Scene scene;  scene.arena = arena, scene.quantize(Ra::Transform(), maxZoom);
                 int charCount = FPDFText_CountChars(text_page);
                 int objectCount = FPDFPage_CountObjects(page);
                 char32_t text[4096], *back;
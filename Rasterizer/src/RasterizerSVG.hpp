@@ -58,12 +58,13 @@ struct RasterizerSVG {
                 p->close();
         }
     }
-    static Ra::Scene createScene(const void *data, size_t size) {
+    //  A maxZoom quantizes points that hold to kQuantizedError pixels at up to that zoom of the SVG's own pixels
+    static Ra::Scene createScene(const void *data, size_t size, Ra::Ref<Ra::Arena> arena = Ra::Ref<Ra::Arena>(), float maxZoom = 0.f) {
         char *terminated = (char *)malloc(size + 1);
         memcpy(terminated, data, size);
         terminated[size] = 0;
         
-        Ra::Scene scene;
+        Ra::Scene scene;  scene.arena = arena, scene.quantize(Ra::Transform(), maxZoom);
         struct NSVGimage *image = terminated ? nsvgParse(terminated, "px", 96) : NULL;
         if (image) {
             if (kWriteOneBigPath) {
@@ -541,6 +541,8 @@ vertex InstancesVertex instances_vertex_main(
         vert.u = cell.ox == kNullIndex ? FLT_MAX : (dx - (cell.lx - cell.ox)) / *width;
         vert.v = 1.0 - (dy - (cell.ly - cell.oy)) / *height;
         vert.cover = inst.quad.cover;
+        //  ox == kNullIndex marks a solid cell, whose oy is its alpha in units of 1 / kNullIndex: kNullIndex for winding spans, less for LOD quads
+        alpha *= cell.ox == kNullIndex ? float(cell.oy) / float(kNullIndex) : 1.0;
     }
     float x = dx / *width * 2.0 - 1.0, y = dy / *height * 2.0 - 1.0;
     float z = kDepthRange * float(iz + 1) / float(*pathCount);